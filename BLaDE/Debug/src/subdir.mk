@@ -6,33 +6,48 @@
 CPP_SRCS += \
 ../src/BLaDE.cpp \
 ../src/BLaDE_Impl.cpp \
+../src/Code128Symbology.cpp \
 ../src/Decoder.cpp \
+../src/EAN13Symbology.cpp \
+../src/EAN8Symbology.cpp \
 ../src/Locator.cpp \
 ../src/Symbology.cpp \
-../src/UPCASymbology.cpp 
+../src/UPCASymbology.cpp \
+../src/UPCESymbology.cpp \
+../src/WorkerPool.cpp 
 
 OBJS += \
 ./src/BLaDE.o \
 ./src/BLaDE_Impl.o \
+./src/Code128Symbology.o \
 ./src/Decoder.o \
+./src/EAN13Symbology.o \
+./src/EAN8Symbology.o \
 ./src/Locator.o \
 ./src/Symbology.o \
-./src/UPCASymbology.o 
+./src/UPCASymbology.o \
+./src/UPCESymbology.o \
+./src/WorkerPool.o 
 
 CPP_DEPS += \
 ./src/BLaDE.d \
 ./src/BLaDE_Impl.d \
+./src/Code128Symbology.d \
 ./src/Decoder.d \
+./src/EAN13Symbology.d \
+./src/EAN8Symbology.d \
 ./src/Locator.d \
 ./src/Symbology.d \
-./src/UPCASymbology.d 
+./src/UPCASymbology.d \
+./src/UPCESymbology.d \
+./src/WorkerPool.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
 src/%.o: ../src/%.cpp
 	@echo 'Building file: $<'
 	@echo 'Invoking: GCC C++ Compiler'
-	g++ -DDEBUG -I/home/kamyon/Projects/BLaDE_released/include -O0 -g3 -Wall -c -fmessage-length=0 -std=c++0x -fPIC -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@:%.o=%.d)" -o "$@" "$<"
+	g++ -DDEBUG -I/home/kamyon/Projects/BLaDE_released/include -O0 -g3 -Wall -c -fmessage-length=0 -std=c++0x -pthread -fPIC -MMD -MP -MF"$(@:%.o=%.d)" -MT"$(@:%.o=%.d)" -o "$@" "$<"
 	@echo 'Finished building: $<'
 	@echo ' '
 
@@ -4,7 +4,7 @@ include $(CLEAR_VARS)
 
 LOCAL_MODULE    := BLaDE
 ### Add all source file names to be included in lib separated by a whitespace
-LOCAL_SRC_FILES := BLaDE_Impl.cpp BLaDE.cpp Decoder.cpp Locator.cpp Symbology.cpp UPCASymbology.cpp
+LOCAL_SRC_FILES := BLaDE_Impl.cpp BLaDE.cpp Code128Symbology.cpp Decoder.cpp EAN13Symbology.cpp EAN8Symbology.cpp Locator.cpp Symbology.cpp UPCASymbology.cpp UPCESymbology.cpp WorkerPool.cpp
 LOCAL_CFLAGS := -O3 -I/home/kamyon/Projects/BLaDE/include
 LOCAL_LDLIBS := -llog
 LOCAL_ARM_MODE := arm
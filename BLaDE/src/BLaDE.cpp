@@ -40,6 +40,11 @@ BLaDE::BLaDE(const TMatrixUInt8 &aImg, const Options &opts/*=Options()*/):
 {
 }
 
+BLaDE::BLaDE(TMatrixUInt8 &aImg, const Options &opts/*=Options()*/):
+	blade_(new _BLaDE(aImg, opts))
+{
+}
+
 BLaDE::~BLaDE()
 {
 }
@@ -49,6 +54,11 @@ BarcodeList& BLaDE::locate()
 	return blade_->locate();
 }
 
+void BLaDE::pushRows(const TUInt8 *rows, TUInt nRows, TUInt stride)
+{
+	blade_->pushRows(rows, nRows, stride);
+}
+
 void BLaDE::addSymbology(BarcodeSymbology* aSymbology)
 {
 	blade_->addSymbology(aSymbology);
@@ -64,4 +74,19 @@ bool BLaDE::decode(Barcode &bc)
 	return blade_->decode(bc);
 }
 
+bool BLaDE::decodeBurst(const std::vector<TMatrixUInt8> &frames, Barcode &bc, TUInt &nFramesExamined)
+{
+	return blade_->decodeBurst(frames, bc, nFramesExamined);
+}
+
+TUInt BLaDE::decodeAll(BarcodeList &barcodes)
+{
+	return blade_->decodeAll(barcodes);
+}
+
+double BLaDE::sharpness() const
+{
+	return blade_->sharpness();
+}
+
 
@@ -32,44 +32,241 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "BLaDE_Impl.h"
 #include "ski/log.h"
-#include "Locator.h"
-#include "Decoder.h"
+#include "WorkerPool.h"
 #include <stdexcept>
+#include <algorithm>
 //Predefined symbologies
 #include "UPCASymbology.h"
+#include "EAN13Symbology.h"
+#include "EAN8Symbology.h"
+#include "UPCESymbology.h"
+#include "Code128Symbology.h"
 
 
 _BLaDE::_BLaDE(const TMatrixUInt8 &aImg, const BLaDE::Options &opts/*=Options()*/):
 		opts_(opts),
-		img_(aImg)
+		img_(aImg),
+		frame_(NULL),
+		sharpness_(0),
+		nPushedRows_(0),
+		nFrames_(0),
+		workers_(new WorkerPool(opts.nThreads))
 {
-	BarcodeLocator::Options locatorOpts;
-	locatorOpts.scale = opts.scale;
-	locatorOpts.nOrientations = opts.nOrientations;
-	locator_ = LocatorPtr(new BarcodeLocator(aImg, locatorOpts));
+	prepareTiles();
+	if (tiles_.empty())
+		locator_ = LocatorPtr(new BarcodeLocator(aImg, locatorOptions()));
+	else
+	{
+		//Only tile-sized locators are needed, one per worker
+		for (TUInt w = 0; w < workers_->size(); w++)
+			tileLocators_.push_back(std::unique_ptr<RegionLocator>(new RegionLocator(img_(tiles_.front()), locatorOptions())));
+	}
+}
+
+_BLaDE::_BLaDE(TMatrixUInt8 &aImg, const BLaDE::Options &opts/*=Options()*/):
+		_BLaDE((const TMatrixUInt8&) aImg, opts)
+{
+	frame_ = &aImg;
 }
 
 _BLaDE::~_BLaDE()
 {
 }
 
+_BLaDE::RegionLocator::RegionLocator(const TMatrixUInt8 &aRegion, const BarcodeLocator::Options &opts):
+	region(aRegion),
+	locator(new BarcodeLocator(region, opts)),
+	sharpness(0)
+{
+}
+
+BarcodeLocator::Options _BLaDE::locatorOptions() const
+{
+	BarcodeLocator::Options locatorOpts;
+	locatorOpts.scale = opts_.scale;
+	locatorOpts.nOrientations = opts_.nOrientations;
+	return locatorOpts;
+}
+
+BarcodeDecoder::Options _BLaDE::decoderOptions() const
+{
+	BarcodeDecoder::Options decoderOpts;
+	//Tiling is meant for stills, where the barcode framing tests for handheld cameras do not apply
+	decoderOpts.checkFraming = tiles_.empty();
+	decoderOpts.nFusedFrames = opts_.nFusedFrames;
+	decoderOpts.nScanlines = opts_.nScanlines;
+	decoderOpts.scanlineSpacing = opts_.scanlineSpacing;
+	decoderOpts.useScanlineMedian = opts_.useScanlineMedian;
+	decoderOpts.useBatchViterbi = opts_.useBatchViterbi;
+	return decoderOpts;
+}
+
+void _BLaDE::prepareTiles()
+{
+	tiles_.clear();
+	TUInt M = img_.rows, N = img_.cols, T = opts_.tileSize;
+	if ( (T == 0) || ( (T >= M) && (T >= N) ) )
+		return;	//no tiling needed
+	if (opts_.tileOverlap >= T)
+		throw std::invalid_argument("Tile overlap must be smaller than the tile size");
+	TUInt tileHeight = min(T, M), tileWidth = min(T, N), stride = T - opts_.tileOverlap;
+	for (TUInt y = 0; ; y += stride)
+	{
+		if (y + tileHeight > M)
+			y = M - tileHeight;	//shift last row of tiles inwards
+		for (TUInt x = 0; ; x += stride)
+		{
+			if (x + tileWidth > N)
+				x = N - tileWidth;	//shift last column of tiles inwards
+			tiles_.push_back(TRectUInt(x, y, tileWidth, tileHeight));
+			if (x + tileWidth >= N)
+				break;
+		}
+		if (y + tileHeight >= M)
+			break;
+	}
+	LOGD("Image of size %ux%u divided into %u tiles of size %ux%u\n", M, N, (TUInt) tiles_.size(), tileHeight, tileWidth);
+}
+
 BarcodeList& _BLaDE::locate()
 {
-	locator_->locate(detectedBarcodes_);
+	nPushedRows_ = 0;	//next frame
+	nFrames_++;
+	if (tiles_.empty())
+	{
+		locator_->locate(detectedBarcodes_);
+		sharpness_ = locator_->sharpness();
+	}
+	else
+		locateTiled();
 	return detectedBarcodes_;
 }
 
+double _BLaDE::sharpness() const
+{
+	return sharpness_;
+}
+
+void _BLaDE::pushRows(const TUInt8 *rows, TUInt nRows, TUInt stride)
+{
+	if (frame_ == NULL)
+		throw std::logic_error("Rows can only be pushed into an image given to the engine as writable");
+	if (nPushedRows_ + nRows > (TUInt) img_.rows)
+		throw std::out_of_range("More rows pushed than the image contains");
+	if (stride < (TUInt) img_.cols)
+		throw std::invalid_argument("Row stride is smaller than the image width");
+	for (TUInt i = 0; i < nRows; i++, rows += stride)
+		std::copy(rows, rows + img_.cols, (*frame_)[nPushedRows_ + i]);
+	nPushedRows_ += nRows;
+	if (locator_)
+		locator_->pushRows(nPushedRows_);
+}
+
+void _BLaDE::locateTiled()
+{
+	for (TUInt w = 0; w < tileLocators_.size(); w++)
+		tileLocators_[w]->barcodes.clear();
+	//Locate in each tile, each worker using its own locator
+	for (TUInt w = 0; w < tileLocators_.size(); w++)
+		tileLocators_[w]->sharpness = 0;
+	workers_->run(tiles_.size(), [this](TUInt n, TUInt w)
+	{
+		RegionLocator &aLocator = *tileLocators_[w];
+		const TRectUInt &aTile = tiles_[n];
+		aLocator.region = img_(aTile);
+		BarcodeList tileBarcodes;
+		aLocator.locator->locate(tileBarcodes);
+		aLocator.sharpness = max(aLocator.sharpness, aLocator.locator->sharpness());
+		//Move to image coordinates
+		TPointInt offset(aTile.x, aTile.y);
+		for (BarcodeList::iterator pBarcode = tileBarcodes.begin(); pBarcode != tileBarcodes.end(); pBarcode++)
+		{
+			pBarcode->firstEdge += offset;
+			pBarcode->lastEdge += offset;
+		}
+		aLocator.barcodes.splice(aLocator.barcodes.end(), tileBarcodes);
+	});
+	//Collect and merge barcodes that span several tiles
+	detectedBarcodes_.clear();
+	sharpness_ = 0;
+	for (TUInt w = 0; w < tileLocators_.size(); w++)
+	{
+		detectedBarcodes_.splice(detectedBarcodes_.end(), tileLocators_[w]->barcodes);
+		sharpness_ = max(sharpness_, tileLocators_[w]->sharpness);
+	}
+	mergeBarcodes(detectedBarcodes_, opts_.tileOverlap);
+	//Longest barcodes first, similar to the ordering of the locator
+	detectedBarcodes_.sort([](const Barcode &a, const Barcode &b) {return norm(a.lastEdge - a.firstEdge) > norm(b.lastEdge - b.firstEdge); });
+	LOGD("%u barcode candidates found in %u tiles\n", (TUInt) detectedBarcodes_.size(), (TUInt) tiles_.size());
+}
+
+void _BLaDE::mergeBarcodes(BarcodeList &barcodes, double maxGap)
+{
+	for (BarcodeList::iterator a = barcodes.begin(); a != barcodes.end(); a++)
+	{
+		BarcodeList::iterator b = a;
+		for (b++; b != barcodes.end(); )
+		{
+			if (merge(*a, *b, maxGap))
+			{
+				barcodes.erase(b);
+				b = a;	//a has grown, recheck the remaining barcodes
+				b++;
+			}
+			else
+				b++;
+		}
+	}
+}
+
+bool _BLaDE::merge(Barcode &a, const Barcode &b, double maxGap)
+{
+	static const double maxSinAngle = 0.17;	//about 10 degrees
+	//Pieces located at different heights of a barcode are offset by less than this fraction of its length,
+	//while stacked parallel barcodes are at least their height apart
+	static const double maxOffset = 0.15;
+	TPointDouble dA = a.lastEdge - a.firstEdge, dB = b.lastEdge - b.firstEdge;
+	double lengthA = norm(dA), lengthB = norm(dB);
+	if ( (lengthA == 0) || (lengthB == 0) )
+		return false;
+	//Should be nearly parallel
+	if (abs(dA.x * dB.y - dA.y * dB.x) > maxSinAngle * lengthA * lengthB)
+		return false;
+	//b should lie on the line through a
+	TPointDouble u = dA * (1 / lengthA);
+	TPointDouble p = b.firstEdge - a.firstEdge, q = b.lastEdge - a.firstEdge;
+	double maxDistance = maxOffset * max(lengthA, lengthB);
+	if ( (abs(u.x * p.y - u.y * p.x) > maxDistance) || (abs(u.x * q.y - u.y * q.x) > maxDistance) )
+		return false;
+	//Extents along the line should overlap or nearly touch
+	double tP = u.x * p.x + u.y * p.y, tQ = u.x * q.x + u.y * q.y;
+	double tBegin = min(tP, tQ), tEnd = max(tP, tQ);
+	if ( (tBegin > lengthA + maxGap) || (tEnd < -maxGap) )
+		return false;
+	//Extend a along its own line to cover both
+	TPointDouble origin = a.firstEdge;
+	a.firstEdge = origin + u * min(tBegin, 0.0);
+	a.lastEdge = origin + u * max(tEnd, lengthA);
+	return true;
+}
+
 void _BLaDE::addSymbology(BarcodeSymbology* aSymbology)
 {
 	//check to make sure that a decoder for this symbology is not already in the list
-	for (std::list<DecoderPtr>::const_iterator pDecoder = decoders_.begin(); pDecoder != decoders_.end(); pDecoder++)
+	for (std::list<DecoderPtr>::const_iterator pDecoder = decoders_.decoders.begin(); pDecoder != decoders_.decoders.end(); pDecoder++)
 	{
 		if ((*pDecoder)->symbology() == aSymbology->name())
 			throw std::logic_error("A decoder for this symbology is already registered");
 	}
 	//No such decoder registered, create
+	TUInt width = aSymbology->width();
 	//decoders_.emplace_back(DecoderPtr(new BarcodeDecoder(img_, aSymbology)));
-	decoders_.push_back(DecoderPtr(new BarcodeDecoder(img_, aSymbology)));
+	decoders_.decoders.push_back(DecoderPtr(new BarcodeDecoder(img_, aSymbology, decoderOptions(), workers_.get())));
+	//Symbologies of the same width share their slices
+	SlicesPtr &slices = decoders_.slices[width];
+	if (!slices)
+		slices.reset(new BarcodeDecoder::Slices(decoderOptions(), width));
+	workerDecoders_.clear();
 }
 
 void _BLaDE::addSymbology(BLaDE::PredefinedSymbology aSymbology)
@@ -79,7 +276,21 @@ void _BLaDE::addSymbology(BLaDE::PredefinedSymbology aSymbology)
 		switch (aSymbology)
 		{
 		case BLaDE::UPCA:
-			addSymbology(new UpcaSymbology());
+		case BLaDE::EAN13:
+			addUpcEanSymbology(aSymbology == BLaDE::EAN13);
+			break;
+		case BLaDE::EAN8:
+			addSymbology(new Ean8Symbology());
+			break;
+		case BLaDE::UPCE:
+			addSymbology(new UpceSymbology());
+			break;
+		case BLaDE::CODE128:
+			if ( (opts_.minCode128Characters < 1) || (opts_.minCode128Characters > opts_.maxCode128Characters) )
+				throw std::invalid_argument("The range of Code 128 lengths is not valid");
+			//Shorter layouts are tried first, the quiet zones of their fits rejecting the parts of longer barcodes
+			for (TUInt n = opts_.minCode128Characters; n <= opts_.maxCode128Characters; n++)
+				addSymbology(new Code128Symbology(n));
 			break;
 		default:
 			LOGE("No symbology class implementation is available for symbology %d\n", aSymbology);
@@ -88,27 +299,213 @@ void _BLaDE::addSymbology(BLaDE::PredefinedSymbology aSymbology)
 	}
 	catch (std::logic_error &aErr)
 	{
-		LOGE("A decoder for this symbology is already registered\n");
+		LOGE("Could not add the symbology: %s\n", aErr.what());
 		throw;
 	}
 }
 
+void _BLaDE::addUpcEanSymbology(bool isEan13)
+{
+	const char *otherName = (isEan13 ? "UPC-A" : "EAN-13");
+	for (std::list<DecoderPtr>::iterator pDecoder = decoders_.decoders.begin(); pDecoder != decoders_.decoders.end(); pDecoder++)
+	{
+		if ((*pDecoder)->symbology() == Ean13Symbology::UPCA_EAN13_NAME)
+			throw std::logic_error("A decoder for this symbology is already registered");
+		if ((*pDecoder)->symbology() == otherName)
+		{
+			//Replace the decoder of the other symbology in place, so that the symbologies are tried in the same order
+			Ean13Symbology::Options symbologyOpts;
+			symbologyOpts.isUpcaReported = true;
+			*pDecoder = DecoderPtr(new BarcodeDecoder(img_, new Ean13Symbology(symbologyOpts), decoderOptions(), workers_.get()));
+			workerDecoders_.clear();
+			return;
+		}
+	}
+	addSymbology(isEan13 ? (BarcodeSymbology*) new Ean13Symbology() : new UpcaSymbology());
+}
+
 bool _BLaDE::decode(Barcode &bc)
 {
+	if (opts_.nCachedFrames == 0)
+		return decode(bc, img_, decoders_);
+	if (findCached(bc))
+		return true;
+	if (!decode(bc, img_, decoders_))
+		return false;
+	addToCache(bc);
+	return true;
+}
+
+TUInt _BLaDE::decodeAll(BarcodeList &barcodes)
+{
+	//Candidates on the same line closer than this fraction of the smaller image dimension are pieces of the same barcode,
+	//while the quiet zones keep neighboring barcodes further apart
+	static const double maxMergeGap = 0.015;
+	mergeBarcodes(barcodes, maxMergeGap * min(img_.rows, img_.cols));
+	//Look the candidates up in the cache before decoding the others concurrently
+	std::vector<Barcode*> candidates;
+	std::vector<char> isDecoded;
+	for (BarcodeList::iterator pBarcode = barcodes.begin(); pBarcode != barcodes.end(); pBarcode++)
+	{
+		candidates.push_back(&(*pBarcode));
+		isDecoded.push_back( (opts_.nCachedFrames > 0) && findCached(*pBarcode) );
+	}
+	if (workerDecoders_.empty())
+	{
+		//The worker decoders neither fuse frames, which would mix different barcodes, nor process their scanlines in parallel.
+		//The framing tests for a handheld camera aimed at a single barcode do not apply to the barcodes sharing a frame.
+		BarcodeDecoder::Options opts = decoderOptions();
+		opts.nFusedFrames = 1;
+		opts.checkFraming = false;
+		for (TUInt w = 0; w < workers_->size(); w++)
+		{
+			std::unique_ptr<DecoderSet> aSet(new DecoderSet());
+			for (std::list<DecoderPtr>::const_iterator pDecoder = decoders_.decoders.begin(); pDecoder != decoders_.decoders.end(); pDecoder++)
+				aSet->decoders.push_back(DecoderPtr(new BarcodeDecoder(**pDecoder, opts)));
+			for (std::map<TUInt, SlicesPtr>::const_iterator pSlices = decoders_.slices.begin(); pSlices != decoders_.slices.end(); pSlices++)
+				aSet->slices[pSlices->first].reset(new BarcodeDecoder::Slices(opts, pSlices->first));
+			workerDecoders_.push_back(std::move(aSet));
+		}
+	}
+	workers_->run(candidates.size(), [this, &candidates, &isDecoded](TUInt n, TUInt w)
+	{
+		if (!isDecoded[n])
+			isDecoded[n] = decode(*candidates[n], img_, *workerDecoders_[w]);
+	});
+	//Keep the first of the barcodes decoded with each estimate
+	std::vector<const Barcode*> decoded;
+	TUInt n = 0;
+	for (BarcodeList::iterator pBarcode = barcodes.begin(); pBarcode != barcodes.end(); n++)
+	{
+		bool isDuplicate = false;
+		for (std::vector<const Barcode*>::const_iterator pDecoded = decoded.begin(); pDecoded != decoded.end() && !isDuplicate; pDecoded++)
+			isDuplicate = ( ((*pDecoded)->estimate == pBarcode->estimate) && ((*pDecoded)->symbology == pBarcode->symbology) );
+		if (!isDecoded[n] || isDuplicate)
+		{
+			pBarcode = barcodes.erase(pBarcode);
+			continue;
+		}
+		if (opts_.nCachedFrames > 0)
+			addToCache(*pBarcode);
+		decoded.push_back(&(*pBarcode));
+		pBarcode++;
+	}
+	LOGD("%u barcodes decoded out of %u candidates\n", (TUInt) barcodes.size(), (TUInt) candidates.size());
+	return barcodes.size();
+}
+
+bool _BLaDE::findCached(Barcode &bc)
+{
+	//The ends of a barcode that has not moved are located within a few pixels of each other. The intensities along it
+	//then only differ by the noise, while moving by a pixel or two changes those near each edge by a good fraction of the contrast.
+	static const double maxEndOffset = 0.05, maxProfileDifference = 0.1;
+	double length = norm(bc.lastEdge - bc.firstEdge), maxOffset = maxEndOffset * length;
+	for (std::list<CachedBarcode>::iterator pCached = cache_.begin(); pCached != cache_.end(); )
+	{
+		if (nFrames_ - pCached->frame >= opts_.nCachedFrames)
+		{
+			LOGD("Cached barcode %s expired\n", pCached->barcode.estimate.c_str());
+			pCached = cache_.erase(pCached);
+			continue;
+		}
+		const Barcode &cached = pCached->barcode;
+		bool isSameOrder = (norm(bc.firstEdge - cached.firstEdge) <= maxOffset) && (norm(bc.lastEdge - cached.lastEdge) <= maxOffset);
+		bool isSwapped = (norm(bc.firstEdge - cached.lastEdge) <= maxOffset) && (norm(bc.lastEdge - cached.firstEdge) <= maxOffset);
+		if (!isSameOrder && !isSwapped)
+		{
+			pCached++;
+			continue;
+		}
+		//Confirm that the image along the cached barcode has not changed
+		const std::vector<TUInt8> &profile = pCached->profile;
+		sampleProfile(cached, img_, profile_);
+		int difference = 0;
+		for (TUInt i = 0; i < profile.size(); i++)
+			difference += abs((int) profile_[i] - (int) profile[i]);
+		int contrast = *std::max_element(profile.begin(), profile.end()) - *std::min_element(profile.begin(), profile.end());
+		if (difference > maxProfileDifference * contrast * profile.size())
+		{
+			LOGD("Cached barcode %s has moved\n", cached.estimate.c_str());
+			pCached = cache_.erase(pCached);
+			continue;
+		}
+		LOGD("Barcode found in the cache as %s with symbology %s\n", cached.estimate.c_str(), cached.symbology.c_str());
+		bc.estimate = cached.estimate;
+		bc.symbology = cached.symbology;
+		return true;
+	}
+	return false;
+}
+
+void _BLaDE::addToCache(const Barcode &bc)
+{
+	cache_.push_back(CachedBarcode(bc, nFrames_));
+	sampleProfile(bc, img_, cache_.back().profile);
+}
+
+void _BLaDE::sampleProfile(const Barcode &bc, const TMatrixUInt8 &img, std::vector<TUInt8> &profile)
+{
+	static const TUInt nSamples = 128;
+	profile.resize(nSamples);
+	double dx = (bc.lastEdge.x - bc.firstEdge.x) / (double) (nSamples - 1), dy = (bc.lastEdge.y - bc.firstEdge.y) / (double) (nSamples - 1);
+	for (TUInt i = 0; i < nSamples; i++)
+	{
+		int x = (int) floor(bc.firstEdge.x + i * dx + 0.5), y = (int) floor(bc.firstEdge.y + i * dy + 0.5);
+		x = max(0, min(x, (int) img.cols - 1));
+		y = max(0, min(y, (int) img.rows - 1));
+		profile[i] = img(y, x);
+	}
+}
+
+bool _BLaDE::decode(Barcode &bc, const TMatrixUInt8 &img, DecoderSet &decoders)
+{
+	//Skip barcodes that are too blurry to decode
+	if ( (bc.sharpness >= 0) && (bc.sharpness < opts_.minSharpness) )
+	{
+		LOGD("Barcode is too blurry to attempt decoding (sharpness %f < %f)\n", bc.sharpness, opts_.minSharpness);
+		return false;
+	}
+	if (decoders.decoders.empty())
+		return false;
+	//The slices and edges only depend on the symbology width, so they are extracted once and shared by the decoders of each width
+	for (std::map<TUInt, SlicesPtr>::iterator pSlices = decoders.slices.begin(); pSlices != decoders.slices.end(); pSlices++)
+	{
+		if (!pSlices->second->reset(bc, img))
+		{
+			LOGD("Barcode is not resolved sufficiently well to attempt decoding\n");
+			return false;
+		}
+	}
+	//Skip the decoders whose symbology does not match the edges detected, and try the others best match first
+	std::vector<std::pair<double, BarcodeDecoder*> > &candidates = decoders.candidates;
+	candidates.clear();
+	for (std::list<DecoderPtr>::iterator pDecoder = decoders.decoders.begin(); pDecoder != decoders.decoders.end(); pDecoder++)
+	{
+		double distance = (*pDecoder)->matchSignature(*decoders.slices[(*pDecoder)->width()]);
+		if (distance < 0)
+		{
+			LOGD("Barcode does not match the signature of symbology %s\n", (*pDecoder)->symbology().c_str());
+			continue;
+		}
+		candidates.push_back(std::make_pair(distance, pDecoder->get()));
+	}
+	std::stable_sort(candidates.begin(), candidates.end(),
+			[](const std::pair<double, BarcodeDecoder*> &a, const std::pair<double, BarcodeDecoder*> &b) {return a.first < b.first; });
 	//Try each decoder in turn until one of them successfully decodes the barcode
-	for (std::list<DecoderPtr>::iterator pDecoder = decoders_.begin(); pDecoder != decoders_.end(); pDecoder++)
+	for (std::vector<std::pair<double, BarcodeDecoder*> >::iterator pCandidate = candidates.begin(); pCandidate != candidates.end(); pCandidate++)
 	{
-		BarcodeDecoder::Result res= (*pDecoder)->read(bc);
+		BarcodeDecoder *decoder = pCandidate->second;
+		BarcodeDecoder::Result res= decoder->read(bc, *decoders.slices[decoder->width()]);
 		switch (res)
 		{
 		case BarcodeDecoder::CANNOT_DECODE:
-			LOGD("Barcode is not resolved sufficiently well to attempt decoding for symbology %s\n", (*pDecoder)->symbology().c_str());
+			LOGD("Barcode is not resolved sufficiently well to attempt decoding for symbology %s\n", decoder->symbology().c_str());
 			break;
 		case BarcodeDecoder::DECODING_FAILED:
-			LOGD("Failed to decode barcode with symbology %s\n", (*pDecoder)->symbology().c_str());
+			LOGD("Failed to decode barcode with symbology %s\n", decoder->symbology().c_str());
 			break;
 		case BarcodeDecoder::DECODING_SUCCESSFUL:
-			LOGD("Successfully decoded barcode as %s with symbology %s\n", bc.estimate.c_str(), (*pDecoder)->symbology().c_str());
+			LOGD("Successfully decoded barcode as %s with symbology %s\n", bc.estimate.c_str(), decoder->symbology().c_str());
 			return true;
 		default:
 			LOGE("Unknown barcode decoding status - should be handled!");
@@ -117,3 +514,69 @@ bool _BLaDE::decode(Barcode &bc)
 	}
 	return false;
 }
+
+bool _BLaDE::decodeBurst(const std::vector<TMatrixUInt8> &frames, Barcode &bc, TUInt &nFramesExamined)
+{
+	nFramesExamined = 0;
+	if (frames.empty())
+		return false;
+	for (std::vector<TMatrixUInt8>::const_iterator pFrame = frames.begin(); pFrame != frames.end(); pFrame++)
+	{
+		if ( (pFrame->rows != img_.rows) || (pFrame->cols != img_.cols) )
+			throw std::invalid_argument("Burst frames must be the same size as the image");
+	}
+	if (burstLocators_.empty())
+	{
+		for (TUInt w = 0; w < workers_->size(); w++)
+			burstLocators_.push_back(std::unique_ptr<RegionLocator>(new RegionLocator(frames.front(), locatorOptions())));
+	}
+	//Locate in each frame, each worker using its own locator
+	std::vector<BarcodeList> frameBarcodes(frames.size());
+	workers_->run(frames.size(), [this, &frames, &frameBarcodes](TUInt n, TUInt w)
+	{
+		RegionLocator &aLocator = *burstLocators_[w];
+		aLocator.region = frames[n];
+		aLocator.locator->locate(frameBarcodes[n]);
+	});
+	//Rank the candidates from all frames by their quality
+	struct Candidate
+	{
+		TUInt frame;
+		Barcode *barcode;
+		double quality;
+		bool operator<(const Candidate &c) const {return quality > c.quality; };	//best first
+	};
+	std::vector<Candidate> candidates;
+	for (TUInt n = 0; n < frames.size(); n++)
+	{
+		for (BarcodeList::iterator pBarcode = frameBarcodes[n].begin(); pBarcode != frameBarcodes[n].end(); pBarcode++)
+		{
+			Candidate aCandidate = {n, &(*pBarcode), quality(*pBarcode, frames[n].size())};
+			candidates.push_back(aCandidate);
+		}
+	}
+	std::stable_sort(candidates.begin(), candidates.end());
+	LOGD("%u barcode candidates found in a burst of %u frames\n", (TUInt) candidates.size(), (TUInt) frames.size());
+	//Decode in order until successful
+	std::vector<bool> isExamined(frames.size(), false);
+	for (std::vector<Candidate>::iterator pCandidate = candidates.begin(); pCandidate != candidates.end(); pCandidate++)
+	{
+		if (!isExamined[pCandidate->frame])
+		{
+			isExamined[pCandidate->frame] = true;
+			nFramesExamined++;
+		}
+		if (decode(*pCandidate->barcode, frames[pCandidate->frame], decoders_))
+		{
+			LOGD("Barcode decoded in frame %u of the burst after examining %u frames\n", pCandidate->frame, nFramesExamined);
+			bc = *pCandidate->barcode;
+			return true;
+		}
+	}
+	return false;
+}
+
+double _BLaDE::quality(const Barcode &bc, const TSizeUInt &imSize)
+{
+	return max(bc.sharpness, 0.0) * bc.edgeDensity * bc.alignmentScore(TSizeInt(imSize));
+}
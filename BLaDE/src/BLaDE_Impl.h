@@ -35,17 +35,20 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "ski/types.h"
 #include <list>
+#include <map>
+#include <vector>
 #include <memory>
 #include "ski/BLaDE/BLaDE.h"
+#include "Locator.h"
+#include "Decoder.h"
 
 #ifdef USE_OPENCV
 #define USING_OPENCV
 #endif
 
 //Forward declarations
-class BarcodeLocator;
-class BarcodeDecoder;
 class BarcodeSymbology;
+class WorkerPool;
 
 /**
  * @class Barcode Location and Decoding Engine High-Level Access
@@ -61,6 +64,13 @@ public:
 	 */
 	_BLaDE(const TMatrixUInt8 &aImg, const BLaDE::Options &opts=BLaDE::Options());
 
+	/**
+	 * Constructor for an image that rows may be pushed into
+	 * @param[in, out] aImg input image to work on, into which pushRows() copies the rows it is given
+	 * @param[in] opts options to use
+	 */
+	_BLaDE(TMatrixUInt8 &aImg, const BLaDE::Options &opts=BLaDE::Options());
+
 	/**
 	 * Destructor
 	 */
@@ -73,25 +83,69 @@ public:
 	BarcodeList& locate();
 
 	/**
-	 * Add symbology to use for decoding. Symbologies are tried in the order they are added.
+	 * Copies the next rows of a frame that arrives row by row into the image associated with this engine.
+	 * Locating work is done on the rows as they arrive, so that only a short amount of work remains for locate()
+	 * once the last row has been pushed. Rows are pushed from the top of the image, and the next frame starts
+	 * after each call to locate(). In tiled mode, the rows are only copied. The engine must have been constructed with
+	 * a writable image, otherwise a logic_error is thrown.
+	 * @param[in] rows pointer to the first pixel of the first row to push
+	 * @param[in] nRows number of rows to push
+	 * @param[in] stride distance in bytes between the starts of consecutive rows in rows
+	 */
+	void pushRows(const TUInt8 *rows, TUInt nRows, TUInt stride);
+
+	/**
+	 * Add symbology to use for decoding. Symbologies whose signature matches the barcode best are tried first,
+	 * in the order they are added when they match equally well.
 	 * @param[in] aSymbology a symbology to try when attempting to decode
 	 */
 	void addSymbology(BarcodeSymbology* aSymbology);
 
 	/**
 	 * Adds a pre-defined symbology (with default options) to use for decoding.
-	 * Symbologies are tried in the order they are added.
+	 * Symbologies are tried as in addSymbology(BarcodeSymbology*). UPC-A and EAN-13 are read by a single decoder when both are added.
 	 * @param[in] aSymbology a symbology to try when attempting to decode
 	 */
 	void addSymbology(BLaDE::PredefinedSymbology aSymbology);
 
 	/**
-	 * Attempt to decode a barcode
+	 * Attempt to decode a barcode. If the barcode cache is enabled (see BLaDE::Options::nCachedFrames), a barcode decoded
+	 * in a recent frame that has not moved since is reported again without decoding.
 	 * @param[in, out] bc a located barcode returned by getLocator->locate()
 	 * @return true if one of the symbologies has correctly decoded the barcode
 	 */
 	bool decode(Barcode &bc);
 
+	/**
+	 * Decodes a barcode from a burst of frames, such as those captured in quick succession by a handheld camera.
+	 * Barcodes are located in every frame, and decoding is attempted on the candidates from all frames in the order
+	 * of their quality (sharpness, edge density and how well they are framed), stopping at the first success.
+	 * The frames must be the same size as the image associated with this engine, and are not tiled.
+	 * @param[in] frames frames of the burst
+	 * @param[out] bc decoded barcode, if any
+	 * @param[out] nFramesExamined number of frames whose candidates were tried for decoding
+	 * @return true if a barcode has been decoded
+	 */
+	bool decodeBurst(const std::vector<TMatrixUInt8> &frames, Barcode &bc, TUInt &nFramesExamined);
+
+	/**
+	 * Decodes all the barcodes located in the image associated with this engine, such as the barcodes on a shelf.
+	 * Unlike decode(), the barcodes are decoded whatever their size and position in the frame.
+	 * Candidates that are pieces of the same barcode are merged first, and the remaining candidates are decoded
+	 * concurrently, each worker using its own copies of the decoders.
+	 * @param[in, out] barcodes barcodes returned by locate(). On return, holds the barcodes decoded, in the same order,
+	 * the later ones of those decoded with the same estimate and symbology being removed.
+	 * @return number of barcodes decoded
+	 */
+	TUInt decodeAll(BarcodeList &barcodes);
+
+	/**
+	 * Sharpness of the last located frame, as the mean gradient magnitude of the pixels in barcode-like regions.
+	 * Can be used to pick the sharpest of several frames. In tiled mode, this is the sharpness of the sharpest tile.
+	 * @return sharpness of the last located frame, 0 if no barcode-like regions were found
+	 */
+	double sharpness() const;
+
 private:
 	/** Options used by BLaDE */
 	BLaDE::Options opts_;
@@ -102,6 +156,8 @@ private:
 
 	/** Image to work on */
 	const TMatrixUInt8 &img_;
+	/** Writable access to the image to work on, that rows are pushed into. NULL if the image was given as read-only */
+	TMatrixUInt8 *frame_;
 
 	///List of detected barcodes
 	BarcodeList detectedBarcodes_;
@@ -109,8 +165,185 @@ private:
 	/** Locator */
 	LocatorPtr locator_;
 
-	/** List of registered decoders (1 for each symbology) */
-	std::list<DecoderPtr> decoders_;
+	/** Smart pointer to the slices of the barcode being decoded */
+	typedef std::unique_ptr<BarcodeDecoder::Slices> SlicesPtr;
+
+	/** Decoders of the registered symbologies, with the state they need to decode a barcode */
+	struct DecoderSet
+	{
+		/** Decoders, one for each symbology */
+		std::list<DecoderPtr> decoders;
+		/**
+		 * Slices of the barcode being decoded for each width of the registered symbologies, shared by the decoders of that width.
+		 * The edge filter spans a fixed number of samples, so slices sampled for a wider symbology detect the edges of a
+		 * narrower one with less smoothing.
+		 */
+		std::map<TUInt, SlicesPtr> slices;
+		/** Decoders matching the barcode being decoded with the distance from their signatures, kept to avoid reallocating */
+		std::vector<std::pair<double, BarcodeDecoder*> > candidates;
+	};
+
+	/** Registered decoders */
+	DecoderSet decoders_;
+
+	/**
+	 * Copies of the registered decoders for each worker, which decode different barcodes concurrently in decodeAll().
+	 * Created on first use, and discarded when a symbology is added.
+	 */
+	std::vector<std::unique_ptr<DecoderSet> > workerDecoders_;
+
+	/**
+	 * Adds the UPC-A or the EAN-13 symbology. UPC-A codes are the EAN-13 codes whose first digit is 0, so once both are added,
+	 * they are read by an EAN-13 decoder reporting UPC-A codes, which costs little more than reading either.
+	 * @param[in] isEan13 true to add EAN-13, false to add UPC-A
+	 */
+	void addUpcEanSymbology(bool isEan13);
+
+	/** Sharpness of the last located frame */
+	double sharpness_;
+
+	/** Number of rows of the current frame pushed so far */
+	TUInt nPushedRows_;
+
+	/** Number of frames located so far */
+	TUInt nFrames_;
+
+	/** Decoded barcode reported again while it stays still, see BLaDE::Options::nCachedFrames */
+	struct CachedBarcode
+	{
+		/** Decoded barcode, with the ends it was located at */
+		Barcode barcode;
+		/** Intensities sampled along the barcode in the frame it was decoded in */
+		std::vector<TUInt8> profile;
+		/** Frame the barcode was decoded in */
+		TUInt frame;
+		/**
+		 * Constructor
+		 * @param[in] bc decoded barcode
+		 * @param[in] aFrame frame the barcode was decoded in
+		 */
+		CachedBarcode(const Barcode &bc, TUInt aFrame): barcode(bc), frame(aFrame) {};
+	};
+
+	/** Barcodes decoded in the last BLaDE::Options::nCachedFrames frames */
+	std::list<CachedBarcode> cache_;
+
+	/** Intensities along the barcode being looked up in the cache, kept to avoid reallocating */
+	std::vector<TUInt8> profile_;
+
+	/** Workers used for parallel processing */
+	std::unique_ptr<WorkerPool> workers_;
+
+	/**
+	 * Locator working on one region at a time, such as the tiles of the image or the frames of a burst.
+	 * The locator is bound to the region header, which is pointed at each region in turn.
+	 */
+	struct RegionLocator
+	{
+		/** Header for the region currently being processed - shares data with the tile or frame */
+		TMatrixUInt8 region;
+		/** Locator bound to region */
+		LocatorPtr locator;
+		/** Barcodes found by this locator in image coordinates */
+		BarcodeList barcodes;
+		/** Sharpness of the sharpest region processed by this locator */
+		double sharpness;
+		/**
+		 * Constructor
+		 * @param[in] aRegion initial region to bind the locator to, all regions must be of the same size
+		 * @param[in] opts locator options
+		 */
+		RegionLocator(const TMatrixUInt8 &aRegion, const BarcodeLocator::Options &opts);
+	};
+
+	/** Tiles covering the image, empty if the whole image is located at once */
+	std::vector<TRectUInt> tiles_;
+
+	/** One tile locator per worker */
+	std::vector<std::unique_ptr<RegionLocator> > tileLocators_;
+
+	/** One burst frame locator per worker, created on first use */
+	std::vector<std::unique_ptr<RegionLocator> > burstLocators_;
+
+	/**
+	 * Options for the locators, derived from the BLaDE options
+	 */
+	BarcodeLocator::Options locatorOptions() const;
+
+	/**
+	 * Options for the decoders, derived from the BLaDE options
+	 */
+	BarcodeDecoder::Options decoderOptions() const;
+
+	/**
+	 * Divides the image into overlapping tiles of equal size, the last row and column of tiles being shifted
+	 * inwards to stay within the image.
+	 */
+	void prepareTiles();
+
+	/**
+	 * Locates barcodes in each tile, and merges the results.
+	 */
+	void locateTiled();
+
+	/**
+	 * Merges barcodes that are pieces of the same barcode, such as the parts of a barcode found in neighboring tiles.
+	 * Two barcodes are merged if they are nearly parallel, and one lies within a small fraction of its length of the line
+	 * through the other, so that stacked parallel barcodes are kept apart, with their extents along the line overlapping
+	 * or separated by less than maxGap.
+	 * @param[in, out] barcodes list of barcodes to merge
+	 * @param[in] maxGap gap in pixels along the line under which barcodes are considered part of the same barcode
+	 */
+	static void mergeBarcodes(BarcodeList &barcodes, double maxGap);
+
+	/**
+	 * Merges barcode b into a if they are pieces of the same barcode, as described in mergeBarcodes().
+	 * @param[in, out] a barcode to extend
+	 * @param[in] b barcode to merge into a
+	 * @param[in] maxGap gap in pixels along the line under which barcodes are considered part of the same barcode
+	 * @return true if b has been merged into a
+	 */
+	static bool merge(Barcode &a, const Barcode &b, double maxGap);
+
+	/**
+	 * Looks a located barcode up in the cache. A cached barcode matches if the ends of both are within a small fraction
+	 * of the barcode length of each other, and is confirmed if the intensities along it have not changed since it was
+	 * decoded. Cached barcodes that have expired or that are not confirmed, as the barcode moved, are dropped.
+	 * @param[in, out] bc a barcode located in the image associated with this engine, given the estimate of the cached barcode if found
+	 * @return true if a confirmed cached barcode is found
+	 */
+	bool findCached(Barcode &bc);
+
+	/**
+	 * Samples the intensities of an image at evenly spaced points between the ends of a barcode
+	 * @param[in] bc located barcode
+	 * @param[in] img image the barcode was located in
+	 * @param[out] profile intensities sampled
+	 */
+	static void sampleProfile(const Barcode &bc, const TMatrixUInt8 &img, std::vector<TUInt8> &profile);
+
+	/**
+	 * Adds a decoded barcode to the cache, see BLaDE::Options::nCachedFrames
+	 * @param[in] bc barcode decoded in the image associated with this engine
+	 */
+	void addToCache(const Barcode &bc);
+
+	/**
+	 * Attempt to decode a barcode in a given image
+	 * @param[in, out] bc a barcode located in img
+	 * @param[in] img image the barcode was located in
+	 * @param[in, out] decoders decoders to use, which must not be in use by another thread
+	 * @return true if one of the symbologies has correctly decoded the barcode
+	 */
+	bool decode(Barcode &bc, const TMatrixUInt8 &img, DecoderSet &decoders);
+
+	/**
+	 * Quality of a located barcode, used to decide which candidates to decode first.
+	 * @param[in] bc located barcode
+	 * @param[in] imSize size of the image the barcode was located in
+	 * @return product of the sharpness, edge density and alignment score (see Barcode::alignmentScore()) of the barcode
+	 */
+	static double quality(const Barcode &bc, const TSizeUInt &imSize);
 };
 
 #endif //BLADE_IMPL_H_
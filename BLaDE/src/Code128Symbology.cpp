@@ -0,0 +1,389 @@
+/*
+Copyright (c) 2012, The Smith-Kettlewell Eye Research Institute
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the The Smith-Kettlewell Eye Research Institute nor
+      the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE SMITH-KETTLEWELL EYE RESEARCH INSTITUTE BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file Code128Symbology.cpp
+ * Code 128 symbology of a given number of characters.
+ * @author Ender Tekin
+ */
+
+#include "Code128Symbology.h"
+#include "ski/log.h"
+#include "ski/math.h"
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+/**
+ * Extends the two best paths into a range of previous states by a symbol value, merging them into the paths of the
+ * states they move to. Without branches, so that the loop can be vectorized.
+ * @param[in] prevBest energies of the best paths into the previous states
+ * @param[in] prevSecondBest energies of the second best paths into the previous states
+ * @param[in] energy energy of the symbol taking the value
+ * @param[in] value value of the symbol
+ * @param[in] n number of states in the range
+ * @param[in,out] best energies of the best paths into the states moved to
+ * @param[in,out] secondBest energies of the second best paths into the states moved to
+ * @param[in,out] values values of the symbol on the best paths into the states moved to
+ */
+inline void mergePaths(const TEnergy *prevBest, const TEnergy *prevSecondBest, TEnergy energy, TUInt8 value, TUInt n,
+		TEnergy *best, TEnergy *secondBest, TUInt8 *values)
+{
+	for (TUInt i = 0; i < n; i++)
+	{
+		TEnergy e = prevBest[i] + energy, e2 = prevSecondBest[i] + energy;
+		bool isBetter = (e < best[i]);
+		secondBest[i] = (isBetter ? min(best[i], e2) : min(secondBest[i], e));
+		values[i] = (isBetter ? value : values[i]);
+		best[i] = (isBetter ? e : best[i]);
+	}
+}
+}
+
+const TUInt Code128Symbology::valuePatterns_[N_VALUES_][SYMBOL_LENGTH_] =
+{
+		{2, 1, 2, 2, 2, 2},
+		{2, 2, 2, 1, 2, 2},
+		{2, 2, 2, 2, 2, 1},
+		{1, 2, 1, 2, 2, 3},
+		{1, 2, 1, 3, 2, 2},
+		{1, 3, 1, 2, 2, 2},
+		{1, 2, 2, 2, 1, 3},
+		{1, 2, 2, 3, 1, 2},
+		{1, 3, 2, 2, 1, 2},
+		{2, 2, 1, 2, 1, 3},
+		{2, 2, 1, 3, 1, 2},
+		{2, 3, 1, 2, 1, 2},
+		{1, 1, 2, 2, 3, 2},
+		{1, 2, 2, 1, 3, 2},
+		{1, 2, 2, 2, 3, 1},
+		{1, 1, 3, 2, 2, 2},
+		{1, 2, 3, 1, 2, 2},
+		{1, 2, 3, 2, 2, 1},
+		{2, 2, 3, 2, 1, 1},
+		{2, 2, 1, 1, 3, 2},
+		{2, 2, 1, 2, 3, 1},
+		{2, 1, 3, 2, 1, 2},
+		{2, 2, 3, 1, 1, 2},
+		{3, 1, 2, 1, 3, 1},
+		{3, 1, 1, 2, 2, 2},
+		{3, 2, 1, 1, 2, 2},
+		{3, 2, 1, 2, 2, 1},
+		{3, 1, 2, 2, 1, 2},
+		{3, 2, 2, 1, 1, 2},
+		{3, 2, 2, 2, 1, 1},
+		{2, 1, 2, 1, 2, 3},
+		{2, 1, 2, 3, 2, 1},
+		{2, 3, 2, 1, 2, 1},
+		{1, 1, 1, 3, 2, 3},
+		{1, 3, 1, 1, 2, 3},
+		{1, 3, 1, 3, 2, 1},
+		{1, 1, 2, 3, 1, 3},
+		{1, 3, 2, 1, 1, 3},
+		{1, 3, 2, 3, 1, 1},
+		{2, 1, 1, 3, 1, 3},
+		{2, 3, 1, 1, 1, 3},
+		{2, 3, 1, 3, 1, 1},
+		{1, 1, 2, 1, 3, 3},
+		{1, 1, 2, 3, 3, 1},
+		{1, 3, 2, 1, 3, 1},
+		{1, 1, 3, 1, 2, 3},
+		{1, 1, 3, 3, 2, 1},
+		{1, 3, 3, 1, 2, 1},
+		{3, 1, 3, 1, 2, 1},
+		{2, 1, 1, 3, 3, 1},
+		{2, 3, 1, 1, 3, 1},
+		{2, 1, 3, 1, 1, 3},
+		{2, 1, 3, 3, 1, 1},
+		{2, 1, 3, 1, 3, 1},
+		{3, 1, 1, 1, 2, 3},
+		{3, 1, 1, 3, 2, 1},
+		{3, 3, 1, 1, 2, 1},
+		{3, 1, 2, 1, 1, 3},
+		{3, 1, 2, 3, 1, 1},
+		{3, 3, 2, 1, 1, 1},
+		{3, 1, 4, 1, 1, 1},
+		{2, 2, 1, 4, 1, 1},
+		{4, 3, 1, 1, 1, 1},
+		{1, 1, 1, 2, 2, 4},
+		{1, 1, 1, 4, 2, 2},
+		{1, 2, 1, 1, 2, 4},
+		{1, 2, 1, 4, 2, 1},
+		{1, 4, 1, 1, 2, 2},
+		{1, 4, 1, 2, 2, 1},
+		{1, 1, 2, 2, 1, 4},
+		{1, 1, 2, 4, 1, 2},
+		{1, 2, 2, 1, 1, 4},
+		{1, 2, 2, 4, 1, 1},
+		{1, 4, 2, 1, 1, 2},
+		{1, 4, 2, 2, 1, 1},
+		{2, 4, 1, 2, 1, 1},
+		{2, 2, 1, 1, 1, 4},
+		{4, 1, 3, 1, 1, 1},
+		{2, 4, 1, 1, 1, 2},
+		{1, 3, 4, 1, 1, 1},
+		{1, 1, 1, 2, 4, 2},
+		{1, 2, 1, 1, 4, 2},
+		{1, 2, 1, 2, 4, 1},
+		{1, 1, 4, 2, 1, 2},
+		{1, 2, 4, 1, 1, 2},
+		{1, 2, 4, 2, 1, 1},
+		{4, 1, 1, 2, 1, 2},
+		{4, 2, 1, 1, 1, 2},
+		{4, 2, 1, 2, 1, 1},
+		{2, 1, 2, 1, 4, 1},
+		{2, 1, 4, 1, 2, 1},
+		{4, 1, 2, 1, 2, 1},
+		{1, 1, 1, 1, 4, 3},
+		{1, 1, 1, 3, 4, 1},
+		{1, 3, 1, 1, 4, 1},
+		{1, 1, 4, 1, 1, 3},
+		{1, 1, 4, 3, 1, 1},
+		{4, 1, 1, 1, 1, 3},
+		{4, 1, 1, 3, 1, 1},
+		{1, 1, 3, 1, 4, 1},
+		{1, 1, 4, 1, 3, 1},
+		{3, 1, 1, 1, 4, 1},
+		{4, 1, 1, 1, 3, 1},
+		{2, 1, 1, 4, 1, 2},
+		{2, 1, 1, 2, 1, 4},
+		{2, 1, 1, 2, 3, 2}
+};
+
+Code128Symbology::Code128Symbology(TUInt nCharacters, const Options &opts/*=Options()*/) :
+		BarcodeSymbology("Code 128"),
+		opts_(opts)
+{
+	if (nCharacters < 1)
+		throw invalid_argument("Code128Symbology: there must be at least one data character");
+	snprintf(lengthName_, sizeof(lengthName_), "Code 128 (%u characters)", nCharacters);
+	name_ = lengthName_;
+	static const TUInt stopPattern[] = {2, 3, 3, 1, 1, 1, 2};
+	//start, data and check characters
+	for (TUInt n = 0; n < nCharacters + 2; n++)
+		addSymbol(11, SYMBOL_LENGTH_);
+	addSymbol(13, 7, stopPattern);
+	LOGD("Code 128 Symbology of %u characters created\n", nCharacters);
+}
+
+Code128Symbology::~Code128Symbology() {}
+
+TUInt Code128Symbology::nPatterns() const
+{
+	return N_VALUES_;
+}
+
+void Code128Symbology::getConvolutionPattern(TUInt value, double x, bool isFlipped, vector<double> &pattern) const
+{
+	pattern.resize(SYMBOL_LENGTH_ + 2);
+	const TUInt *vP = valuePatterns_[value];
+	if (isFlipped)
+		vP += SYMBOL_LENGTH_ - 1;
+	vector<double>::iterator p = pattern.begin();
+	//extend one X prior to symbol
+	double width = x;
+	*p = x;
+	//value pattern in symbol
+	for (p++; p != pattern.end() - 1; p++)
+	{
+		width += (*vP) * x;
+		*p = width;
+		isFlipped ? vP-- : vP++;
+	}
+	//extend one X past symbol
+	*p = width + x;
+}
+
+int Code128Symbology::darkModuleParity(TUInt i) const
+{
+	return 0;
+}
+
+const char* Code128Symbology::estimateName(const string &anEstimate) const
+{
+	return "Code 128";
+}
+
+void Code128Symbology::solveChecksumPaths(const TMatEnergy &energies, TEnergy *bestEnergies, TEnergy *secondBestEnergies,
+		vector<TUInt8> &values) const
+{
+	//The checksum is the start value plus the sum of each data value weighted by its position, mod 103
+	const TUInt nCharacters = nDataSymbols() - 2;
+	values.resize((nCharacters + 1) * N_DATA_VALUES_);
+	for (TUInt state = 0; state < N_DATA_VALUES_; state++)
+		bestEnergies[state] = secondBestEnergies[state] = ski::MaxValue<TEnergy>() / 2;
+	for (TUInt start = START_A_; start <= START_C_; start++)
+	{
+		bestEnergies[start - N_DATA_VALUES_] = energies(start, 0);
+		values[start - N_DATA_VALUES_] = (TUInt8) start;
+	}
+	TEnergy prevBest[N_DATA_VALUES_], prevSecondBest[N_DATA_VALUES_];
+	for (TUInt t = 1; t <= nCharacters; t++)
+	{
+		for (TUInt state = 0; state < N_DATA_VALUES_; state++)
+		{
+			prevBest[state] = bestEnergies[state];
+			prevSecondBest[state] = secondBestEnergies[state];
+			bestEnergies[state] = secondBestEnergies[state] = ski::MaxValue<TEnergy>() / 2;
+		}
+		TUInt8 *symbolValues = &values[t * N_DATA_VALUES_];
+		for (TUInt value = 0; value < N_DATA_VALUES_; value++)
+		{
+			//State s moves to (s + shift) mod 103: states [0, 103 - shift) move up by shift and the others wrap around to 0
+			TUInt shift = (t * value) % N_DATA_VALUES_, nUnwrapped = N_DATA_VALUES_ - shift;
+			TEnergy energy = energies(value, t);
+			mergePaths(prevBest, prevSecondBest, energy, (TUInt8) value, nUnwrapped,
+					bestEnergies + shift, secondBestEnergies + shift, symbolValues + shift);
+			mergePaths(prevBest + nUnwrapped, prevSecondBest + nUnwrapped, energy, (TUInt8) value, shift,
+					bestEnergies, secondBestEnergies, symbolValues);
+		}
+	}
+}
+
+bool Code128Symbology::isVerified(const TMatEnergy &energies, const vector<TUInt> &estimate, TEnergy bestEnergy,
+		TEnergy secondBestEnergy, const string &estimateStr) const
+{
+	//Margin test
+	double margin = (secondBestEnergy - bestEnergy) / ((double) bestEnergy);
+	if (margin < opts_.minMargin)
+	{
+		LOGD("Barcode estimate %s failed margin test (%f < %f)\n", estimateStr.c_str(), margin, opts_.minMargin);
+		return false;
+	}
+	//Individual most likely values, among the start values for the first symbol and the data values for the others
+	int nDifferentValues = 0;
+	for (TUInt symbol = 0; symbol < estimate.size(); symbol++)
+	{
+		TUInt firstValue = (symbol == 0 ? START_A_ : 0), lastValue = (symbol == 0 ? START_C_ : N_DATA_VALUES_ - 1);
+		for (TUInt value = firstValue; value <= lastValue; value++)
+		{
+			if ( (value != estimate[symbol]) && (energies(value, symbol) < energies(estimate[symbol], symbol)) )
+			{
+				nDifferentValues++;
+				break;
+			}
+		}
+		if (nDifferentValues > 1)
+		{
+			LOGD("Barcode estimate %s failed consistency test (more than 1 symbol is not most likely)\n", estimateStr.c_str());
+			return false;
+		}
+	}
+	LOGD("Estimated barcode %s with energy = %f, margin = %4.3f\n", estimateStr.c_str(), (double) bestEnergy, margin);
+	return true;
+}
+
+string Code128Symbology::estimate(const TMatEnergy &energies) const
+{
+	//-----------
+	//Joint estimation with the check character
+	//-----------
+	const TUInt nSymbols = nDataSymbols(), nCharacters = nSymbols - 2;
+	if ( (energies.rows != nPatterns()) || (energies.cols != nSymbols) )
+		throw logic_error("Code128Symbology: unexpected number of data symbols or patterns");
+	TEnergy bestEnergies[N_DATA_VALUES_], secondBestEnergies[N_DATA_VALUES_];
+	vector<TUInt8> values;
+	solveChecksumPaths(energies, bestEnergies, secondBestEnergies, values);
+	//The check character is the checksum
+	TEnergy bestEnergy = ski::MaxValue<TEnergy>(), secondBestEnergy = ski::MaxValue<TEnergy>();
+	TUInt bestState = 0;
+	for (TUInt state = 0; state < N_DATA_VALUES_; state++)
+	{
+		TEnergy checkEnergy = energies(state, nSymbols - 1), energy = bestEnergies[state] + checkEnergy;
+		if (energy < bestEnergy)
+		{
+			secondBestEnergy = min(bestEnergy, secondBestEnergies[state] + checkEnergy);
+			bestEnergy = energy;
+			bestState = state;
+		}
+		else
+			secondBestEnergy = min(secondBestEnergy, energy);
+	}
+	if (bestEnergy >= ski::MaxValue<TEnergy>() / 4)
+		return string();
+	//Backtrack the values
+	vector<TUInt> estimate(nSymbols);
+	TUInt state = bestState;
+	estimate[nSymbols - 1] = state;
+	for (TUInt t = nCharacters; t > 0; t--)
+	{
+		estimate[t] = values[t * N_DATA_VALUES_ + state];
+		state = (state + N_DATA_VALUES_ - (t * estimate[t]) % N_DATA_VALUES_) % N_DATA_VALUES_;
+	}
+	estimate[0] = values[state];
+
+	//-----------
+	//Checks
+	//-----------
+	string estimateStr = convertEstimateToString(estimate);
+	return (isVerified(energies, estimate, bestEnergy, secondBestEnergy, estimateStr) ? estimateStr : string());
+}
+
+string Code128Symbology::convertEstimateToString(const vector<TUInt> &aEstimate) const
+{
+	enum CodeSet {CODE_A, CODE_B, CODE_C};
+	static const TUInt SHIFT = 98, CODE_C_SWITCH = 99, CODE_B_SWITCH = 100, CODE_A_SWITCH = 101, FNC1 = 102;
+	static const char GROUP_SEPARATOR = 29;
+	string estimateStr;
+	int codeSet = (int) aEstimate.front() - START_A_;
+	bool isShifted = false;
+	//Skip the start and check characters
+	for (TUInt i = 1; i < aEstimate.size() - 1; i++)
+	{
+		TUInt value = aEstimate[i];
+		int set = (isShifted ? CODE_A + CODE_B - codeSet : codeSet);
+		isShifted = false;
+		if (value == FNC1)
+		{
+			if (i > 1)
+				estimateStr += GROUP_SEPARATOR;
+		}
+		else if (set == CODE_C)
+		{
+			if (value < 100)
+			{
+				estimateStr += (char) ('0' + value / 10);
+				estimateStr += (char) ('0' + value % 10);
+			}
+			else
+				codeSet = (value == CODE_B_SWITCH ? CODE_B : CODE_A);
+		}
+		else if (value < 96)
+			estimateStr += (char) ( (set == CODE_A) && (value >= 64) ? value - 64 : value + 32 );
+		else if (value == SHIFT)
+			isShifted = true;
+		else if (value == CODE_C_SWITCH)
+			codeSet = CODE_C;
+		else if ( (value == CODE_B_SWITCH) && (set == CODE_A) )
+			codeSet = CODE_B;
+		else if ( (value == CODE_A_SWITCH) && (set == CODE_B) )
+			codeSet = CODE_A;
+		//FNC2, FNC3 and FNC4 are dropped
+	}
+	return estimateStr;
+}
@@ -0,0 +1,166 @@
+/*
+Copyright (c) 2012, The Smith-Kettlewell Eye Research Institute
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the The Smith-Kettlewell Eye Research Institute nor
+      the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE SMITH-KETTLEWELL EYE RESEARCH INSTITUTE BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file Code128Symbology.h
+ * Code 128 symbology of a given number of characters.
+ * @author Ender Tekin
+ */
+
+#ifndef CODE128SYMBOLOGY_H_
+#define CODE128SYMBOLOGY_H_
+
+#include "ski/BLaDE/Symbology.h"
+#include "ski/types.h"
+
+/**
+ * Code 128 symbology, which encodes a start character, the data characters and a check character in symbols of
+ * three bars and three spaces over eleven modules, followed by a stop pattern of thirteen modules.
+ * Each symbol takes one of 106 values, the start characters selecting the initial code set (A, B or C).
+ * Code 128 barcodes have a variable length, while layouts have a constant width, so a symbology is created for each
+ * number of data characters to read.
+ */
+class Code128Symbology: public BarcodeSymbology
+{
+public:
+	/**
+	 * Decoding options
+	 */
+	struct Options
+	{
+		/** minimum barcode energy margin to pass verification */
+		double minMargin;
+		/** Constructor */
+		Options():
+			minMargin(0.008)
+		{};
+	};
+
+	/**
+	 * Constructor
+	 * @param[in] nCharacters number of data characters between the start and the check characters
+	 * @param[in] opts decoding options
+	 */
+	Code128Symbology(TUInt nCharacters, const Options &opts = Options());
+
+	/**
+	 * Destructor
+	 */
+	virtual ~Code128Symbology();
+
+	/**
+	 * Number of convolution patterns: the 103 data values followed by the three start characters
+	 */
+	virtual TUInt nPatterns() const;
+
+	/**
+	 * Returns a convolution pattern to the decoder
+	 * @param[in] value symbol value to return the pattern for
+	 * @param[in] fundamental width
+	 * @param[in] whether the pattern is horizontally flipped
+	 * @param[out] pattern pattern to use for convolution.
+	 */
+	virtual void getConvolutionPattern(TUInt value, double x, bool isFlipped, vector<double> &pattern) const;
+
+	/**
+	 * Parity of the number of dark modules in a data symbol.
+	 * @param[in] i index of the data symbol
+	 * @return 0, as the bars of every symbol span an even number of modules
+	 */
+	virtual int darkModuleParity(TUInt i) const;
+
+	/**
+	 * Estimates the barcode from the matrix of pattern energies for each symbol
+	 * @param[in] energies matrix of pattern energies per symbol
+	 * @return the decoded data characters, empty string if estimate fails verification
+	 */
+	string estimate(const TMatEnergy &energies) const;
+
+	/**
+	 * Name of the symbology of an estimate, which is the same for all lengths
+	 * @param[in] anEstimate estimate returned by estimate()
+	 * @return "Code 128"
+	 */
+	virtual const char* estimateName(const string &anEstimate) const;
+
+	/**
+	 * Converts the symbol values to the encoded characters, switching code sets as the values instruct.
+	 * Function characters are dropped, except for FNC1 after the first character, which is reported as the GS separator.
+	 * @param[in] aEstimate values of the start, data and check symbols
+	 * @return the encoded characters
+	 */
+	virtual string convertEstimateToString(const vector<TUInt> &aEstimate) const;
+
+protected:
+	/** Number of bars and spaces in a symbol */
+	static const TUInt SYMBOL_LENGTH_ = 6;
+
+	/** Number of values a data or check symbol can take, which is also the checksum modulus */
+	static const TUInt N_DATA_VALUES_ = 103;
+
+	/** Number of symbol values, including the start characters */
+	static const TUInt N_VALUES_ = 106;
+
+	/** Values of the start characters of code sets A, B and C */
+	static const TUInt START_A_ = 103, START_B_ = 104, START_C_ = 105;
+
+	/** Widths of the bars and spaces of each symbol value */
+	static const TUInt valuePatterns_[N_VALUES_][SYMBOL_LENGTH_];
+
+	/** Decoding options */
+	Options opts_;
+
+	/** Name including the number of characters, so that the symbologies of each length can be told apart */
+	char lengthName_[40];
+
+	/**
+	 * Finds the two lowest energy paths into each checksum state over the start and data characters.
+	 * The paths into each state are updated for each value of a symbol over two contiguous ranges of states,
+	 * as the checksum weight rotates the states, so that the compiler can vectorize the updates.
+	 * @param[in] energies matrix of pattern energies per symbol
+	 * @param[out] bestEnergies bestEnergies[state] is the energy of the best path into state (mod 103)
+	 * @param[out] secondBestEnergies secondBestEnergies[state] is the energy of the second best path into state
+	 * @param[out] values values[t * N_DATA_VALUES_ + state] is the value of symbol t on the best path into state at symbol t
+	 */
+	void solveChecksumPaths(const TMatEnergy &energies, TEnergy *bestEnergies, TEnergy *secondBestEnergies, vector<TUInt8> &values) const;
+
+	/**
+	 * Checks that an estimate is confident enough
+	 * @param[in] energies matrix of pattern energies per symbol
+	 * @param[in] estimate values of all symbols of the estimate
+	 * @param[in] bestEnergy energy of the estimate
+	 * @param[in] secondBestEnergy energy of the second best estimate
+	 * @param[in] estimateStr estimate converted to characters
+	 * @return true if the estimate passes the margin test and at most one symbol does not take its most likely value
+	 */
+	bool isVerified(const TMatEnergy &energies, const vector<TUInt> &estimate, TEnergy bestEnergy, TEnergy secondBestEnergy,
+			const string &estimateStr) const;
+};
+
+
+#endif /* CODE128SYMBOLOGY_H_ */
@@ -35,16 +35,158 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "ski/viterbi.h"
 #include "ski/log.h"
 #include "algorithms.h"
+#ifdef _LIBTEST
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#endif
 
-BarcodeDecoder::BarcodeDecoder(const TMatrixUInt8 &img, BarcodeSymbology *aSymbology, const Options &opts/*=Options()*/):
+BarcodeDecoder::Slices::Slices(const Options &opts, TUInt width):
+	opts_(opts),
+	width_(width),
+	img_(NULL),
+	scanlines_(opts.nScanlines)
+{
+	if (opts_.nScanlines < 1)
+		throw invalid_argument("BarcodeDecoder: there must be at least one scanline");
+	for (vector<ScanlineSlice>::iterator pScanline = scanlines_.begin(); pScanline != scanlines_.end(); pScanline++)
+	{
+		pScanline->slice.resize((width_ + 4) * opts_.fundamentalWidth);
+		pScanline->edges.reserve(100);	//reserve space assuming no more than 100 edges detected
+		pScanline->isExtracted = pScanline->isInImage = false;
+	}
+}
+
+bool BarcodeDecoder::Slices::reset(const Barcode &bc, const TMatrixUInt8 &img)
+{
+	img_ = &img;
+	firstEdge_ = bc.firstEdge;
+	lastEdge_ = bc.lastEdge;
+	for (vector<ScanlineSlice>::iterator pScanline = scanlines_.begin(); pScanline != scanlines_.end(); pScanline++)
+		pScanline->isExtracted = false;
+	return (norm(bc.lastEdge - bc.firstEdge) > 0) && shouldAttemptDecoding(bc, img);
+}
+
+bool BarcodeDecoder::Slices::extract(TUInt k)
+{
+	ScanlineSlice &scanline = scanlines_[k];
+	if (!scanline.isExtracted)
+	{
+		//Scanlines are spread evenly across the bars, perpendicular to the line between the located ends
+		TPointDouble d = lastEdge_ - firstEdge_;
+		double length = norm(d);
+		TPointDouble normal(-d.y / length, d.x / length);
+		TPointInt offset(normal * (((double) k - 0.5 * (scanlines_.size() - 1)) * opts_.scanlineSpacing * length));
+		scanline.isInImage = extractIntegralSlice(*img_, firstEdge_ + offset, lastEdge_ + offset, scanline.slice);
+		if (scanline.isInImage)
+			extractEdges(scanline.slice, scanline.edges);
+		else
+			scanline.edges.clear();
+		scanline.isExtracted = true;
+	}
+	return scanline.isInImage;
+}
+
+void BarcodeDecoder::Slices::extractAll(WorkerPool *workers)
+{
+	const TUInt nScanlines = scanlines_.size();
+	TUInt nExtracted = 0;
+	for (vector<ScanlineSlice>::const_iterator pScanline = scanlines_.begin(); pScanline != scanlines_.end(); pScanline++)
+		nExtracted += (pScanline->isExtracted ? 1 : 0);
+	if (nExtracted == nScanlines)
+		return;
+	if ( (workers != NULL) && (nScanlines - nExtracted > 1) )
+		workers->run(nScanlines, [this](TUInt k, TUInt /*worker*/) {extract(k); });
+	else
+	{
+		for (TUInt k = 0; k < nScanlines; k++)
+			extract(k);
+	}
+}
+
+BarcodeDecoder::Scanline::Scanline(TUInt nFixedEdges, TUInt nSymbols, TUInt nPatterns):
+	slice(NULL),
+	detectedEdges(NULL),
+	fixedEdgeCandidates(nFixedEdges),
+	priors(nFixedEdges),
+	conditionals(nFixedEdges - 1, TMatEnergy(0,0)),
+	conditionalBuffers(nFixedEdges - 1, TMatEnergy(0,0)),
+	bands(nFixedEdges - 1),
+	isLocalized(false),
+	fitEnergy(0),
+	fitWidth(0),
+	energies(nPatterns, nSymbols, 0.0),
+	convolutions(nPatterns)
+{
+}
+
+BarcodeDecoder::BarcodeDecoder(const TMatrixUInt8 &img, BarcodeSymbology *aSymbology, const Options &opts/*=Options()*/, WorkerPool *workers/*=NULL*/):
+	BarcodeDecoder(img, std::shared_ptr<BarcodeSymbology>(aSymbology),
+			std::shared_ptr<BarcodeSymbology>(aSymbology->isSymmetric() ? NULL : aSymbology->createMirroredLayout()), opts, workers)
+{
+}
+
+BarcodeDecoder::BarcodeDecoder(const BarcodeDecoder &aDecoder, const Options &opts, WorkerPool *workers/*=NULL*/):
+	BarcodeDecoder(aDecoder.image_, aDecoder.symbology_, aDecoder.mirroredLayout_, opts, workers)
+{
+}
+
+BarcodeDecoder::BarcodeDecoder(const TMatrixUInt8 &img, const std::shared_ptr<BarcodeSymbology> &aSymbology,
+		const std::shared_ptr<BarcodeSymbology> &aMirroredLayout, const Options &opts, WorkerPool *workers):
 	opts_(opts),
 	image_(img),
 	symbology_(aSymbology),
+	mirroredLayout_(aMirroredLayout),
+	signature_(symbology_->signature()),
 	nSymbols_(symbology_->nDataSymbols()),
-	slice_((symbology_->width() + 4) * opts.fundamentalWidth),
-	energies_(10, nSymbols_),
-	convolutions_(10, nSymbols_)
+	nPatterns_(symbology_->nPatterns()),
+	patternSetSize_(symbology_->patternSetSize()),
+	workers_(workers),
+	slices_(opts, symbology_->width()),
+	sliceMargin_(2),
+	fixedEdgeBatch_(1),
+	estimateBatch_(2),
+	nFusedFrames_(0),
+	newestFusedFrame_(0),
+	fusedEnergies_(nPatterns_, nSymbols_)
 {
+	if (opts_.nScanlines < 1)
+		throw invalid_argument("BarcodeDecoder: there must be at least one scanline");
+	if ( (patternSetSize_ < 1) || (nPatterns_ % patternSetSize_ != 0) )
+		throw logic_error("BarcodeDecoder: the patterns of the symbology must divide into sets of the same size");
+	for (TUInt s = 0; s < nSymbols_; s++)
+	{
+		nSymbolPatterns_.push_back(symbology_->nSymbolPatterns(s));
+		if ( (nSymbolPatterns_.back() > nPatterns_) || (nSymbolPatterns_.back() % patternSetSize_ != 0) )
+			throw logic_error("BarcodeDecoder: data symbols must take whole sets of the patterns of the symbology");
+	}
+	flatLayouts_[FORWARD] = symbology_->flatLayout();
+	flatLayouts_[BACKWARD] = (mirroredLayout_ ? mirroredLayout_->flatLayout() : flatLayouts_[FORWARD]);
+	scanlines_.reserve(opts_.nScanlines);
+	for (TUInt k = 0; k < opts_.nScanlines; k++)
+		scanlines_.push_back(Scanline(symbology_->nFixedEdges(), nSymbols_, nPatterns_));
+	if (mirroredLayout_)
+	{
+		mirroredScanlines_.reserve(opts_.nScanlines);
+		for (TUInt k = 0; k < opts_.nScanlines; k++)
+			mirroredScanlines_.push_back(Scanline(mirroredLayout_->nFixedEdges(), nSymbols_, nPatterns_));
+	}
+	for (int dir = FORWARD; dir < FINISHED; dir++)
+		energies_.push_back(TMatEnergy(nPatterns_, nSymbols_, 0.0));
+	fittingScanlines_.reserve(opts_.nScanlines);
+	batchEnergies_.reserve(FINISHED);
+	scanlineEnergies_.reserve(opts_.nScanlines);
+	edgeMagnitudes_.reserve(100);	//as many as the edges reserved by the slices
+	guardBars_.reserve(100);
+	initConvolutionWeights();
+	fusedFrames_.resize(opts_.nFusedFrames > 1 ? opts_.nFusedFrames : 0);
+	fusedFrameDirections_.resize(fusedFrames_.size(), 0);
+	for (vector<vector<TMatEnergy> >::iterator pFrame = fusedFrames_.begin(); pFrame != fusedFrames_.end(); pFrame++)
+	{
+		for (int dir = FORWARD; dir < FINISHED; dir++)
+			pFrame->push_back(TMatEnergy(nPatterns_, nSymbols_));
+	}
+
 	LOGD("Decoder created for symbology %s (%u symbols of total width %u, with %u edges)\n",
 			symbology_->name(), symbology_->nDataSymbols(), symbology_->width(), symbology_->nTotalEdges());
 }
@@ -54,31 +196,87 @@ BarcodeDecoder::~BarcodeDecoder()
 }
 
 BarcodeDecoder::Result BarcodeDecoder::read(Barcode &bc)
+{
+	return read(bc, image_);
+}
+
+BarcodeDecoder::Result BarcodeDecoder::read(Barcode &bc, const TMatrixUInt8 &img)
+{
+	if (!slices_.reset(bc, img))
+		return CANNOT_DECODE;
+	return read(bc, slices_);
+}
+
+BarcodeDecoder::Result BarcodeDecoder::read(Barcode &bc, Slices &slices)
 {
 	try
 	{
-		if (!shouldAttemptDecoding(bc))
-			return CANNOT_DECODE;
-		//At this TPointInt, we have an approximately oriented barcode, extract detection slice
-		extractIntegralSlice(image_, bc.firstEdge, bc.lastEdge);
-		//Localize the fixed edges = symbol boundaries
-		vector<SymbolBoundary> boundaries;
-		if (localizeFixedEdges(boundaries))
+		if ( (slices.nScanlines() != scanlines_.size()) || (slices.width() < symbology_->width()) )
+			throw logic_error("BarcodeDecoder: the slices do not match the scanlines or are too narrow for the symbology");
+		//The slices extend two fundamental widths of the widest symbology past the barcode ends
+		sliceMargin_ = 2.0 * symbology_->width() / slices.width();
+		//At this TPointInt, we have an approximately oriented barcode, extract detection slices and localize the fixed edges = symbol boundaries
+		TUInt nLocalized[FINISHED];
+		if (localizeScanlines(slices, nLocalized) > 0)
 		{
 			string estimatedBarcode;
-			//Try to decode
+			//If fusing, add a slot for the energies of this frame
+			bool isFusing = (opts_.nFusedFrames > 1), isSwapped = false;
+			if (isFusing)
+			{
+				isSwapped = trackBarcode(bc);
+				newestFusedFrame_ = (newestFusedFrame_ + 1) % fusedFrames_.size();
+				nFusedFrames_ = min(nFusedFrames_ + 1, (TUInt) fusedFrames_.size());
+				fusedFrameDirections_[newestFusedFrame_] = 0;
+			}
+			//Try to decode, in the inferred direction only if it is clear
+			int inferredDir = inferDirection();
+			//If both directions are to be tried, estimate them together
+			bool isBatched = ( opts_.useBatchViterbi && (inferredDir == FINISHED) && (nLocalized[FORWARD] > 0) && (nLocalized[BACKWARD] > 0) );
+			if (isBatched)
+			{
+				batchEnergies_.clear();
+				for (int dir = FORWARD; dir < FINISHED; dir++)
+				{
+					getDigitEnergies(dir);
+					batchEnergies_.push_back(&energies_[dir]);
+				}
+				LOGD("Attempting estimation of barcode as %s in both directions:\n", symbology_->name());
+				symbology_->estimateBatch(batchEnergies_, estimateBatch_, batchEstimates_);
+			}
 			for (int dir = FORWARD; dir < FINISHED; dir++) //for each direction
 			{
-				//Convolve with the patterns to get energies
-				getDigitEnergies(dir, boundaries);
-				//Estimate barcode with this symbology
-				LOGD("Attempting estimation of barcode as %s in the %s direction:\n", symbology_->name(), (dir == FORWARD ? "forward" : "backward"));
-				estimatedBarcode = symbology_->estimate(energies_);
+				if ( ( (inferredDir != FINISHED) && (dir != inferredDir) ) || (nLocalized[dir] == 0) )
+					continue;
+				if (isBatched)
+					estimatedBarcode = batchEstimates_[dir];
+				else
+				{
+					//Convolve with the patterns to get energies
+					getDigitEnergies(dir);
+					//Estimate barcode with this symbology
+					LOGD("Attempting estimation of barcode as %s in the %s direction:\n", symbology_->name(), (dir == FORWARD ? "forward" : "backward"));
+					estimatedBarcode = symbology_->estimate(energies_[dir]);
+				}
+				//If this frame alone is not enough, try the evidence accumulated over the tracked frames
+				if (estimatedBarcode.empty() && isFusing)
+				{
+					int trackedDir = (isSwapped ? FINISHED - 1 - dir : dir);
+					TMatEnergy &frameEnergies = fusedFrames_[newestFusedFrame_][trackedDir];
+					for (TUInt d = 0; d < nPatterns_; d++)
+					{
+						for (TUInt s = 0; s < nSymbols_; s++)
+							frameEnergies(d, s) = energies_[dir](d, s);
+					}
+					fusedFrameDirections_[newestFusedFrame_] |= (1 << trackedDir);
+					estimatedBarcode = estimateFused(trackedDir);
+				}
 				//if correct estimate, quit and return the estimate
 				if (!estimatedBarcode.empty())
 				{
+					nFusedFrames_ = 0;	//start anew with the next barcode
 					bc.estimate = estimatedBarcode;
-					bc.symbology = symbology_->name();
+					bc.symbology = symbology_->estimateName(estimatedBarcode);
 					return DECODING_SUCCESSFUL;
 				}
 			}
@@ -94,9 +292,9 @@ BarcodeDecoder::Result BarcodeDecoder::read(Barcode &bc)
 	return CANNOT_DECODE;
 }
 
-bool BarcodeDecoder::shouldAttemptDecoding(const Barcode &bc)
+bool BarcodeDecoder::Slices::shouldAttemptDecoding(const Barcode &bc, const TMatrixUInt8 &img) const
 {
-	TUInt M = image_.rows, N = image_.cols;
+	TUInt M = img.rows, N = img.cols;
 	TPointDouble d = bc.lastEdge - bc.firstEdge;
 	LOGD("Detecting whether barcode (%d,%d)-(%d,%d) is %f degrees should be decoded\n", bc.firstEdge.x, bc.firstEdge.y, bc.lastEdge.x, bc.lastEdge.y, atan2(d.y, d.x) * 180.0 / ski::PI);
 	//double angle = atan2(d.y, d.x);
@@ -104,7 +302,7 @@ bool BarcodeDecoder::shouldAttemptDecoding(const Barcode &bc)
 	//double w = norm(d), maxWidth = .8 * imWidth, minWidth = .4 * imWidth;
 	//bool isTooSmall = (w < minWidth), isTooBig = (w > maxWidth);
 	int w = abs(d.x), h = abs(d.y);
-	bool isTooSmall = ( (w < .4 * N) && (h < .4 * M) ), isTooBig = ( (w > .8 * N) || (h > .8 * M) );
+	bool isTooSmall = opts_.checkFraming && ( (w < .4 * N) && (h < .4 * M) ), isTooBig = opts_.checkFraming && ( (w > .8 * N) || (h > .8 * M) );
 
 	int minDist = min(M, N) / 20; //how far the edges should be from the edge of the image
 	int leftDist = min(bc.firstEdge.x, bc.lastEdge.x), rightDist = N - max(bc.firstEdge.x, bc.lastEdge.x);
@@ -134,10 +332,205 @@ bool BarcodeDecoder::shouldAttemptDecoding(const Barcode &bc)
 	//return ( (w < maxWidth) && (w > minWidth) && (leftDist > minDist) && (rightDist > minDist) && (topDist > minDist) && (botDist > minDist) );
 }
 
-void BarcodeDecoder::extractIntegralSlice(const TMatrixUInt8& aImg, TPointInt firstEdge, TPointInt lastEdge)
+bool BarcodeDecoder::trackBarcode(const Barcode &bc)
+{
+	//The located ends of a barcode can move considerably from frame to frame, so the barcode is tracked by its center
+	//and orientation. The symbol boundaries are localized anew in each frame, which aligns the energies.
+	static const double minCosAngle = 0.95;	//about 18 degrees
+	TPointDouble d = bc.lastEdge - bc.firstEdge, dTracked = trackedLastEdge_ - trackedFirstEdge_;
+	double length = norm(d), trackedLength = norm(dTracked);
+	if ( (nFusedFrames_ > 0) && (length > 0) && (trackedLength > 0) )
+	{
+		TPointDouble centerOffset = (bc.firstEdge + bc.lastEdge - trackedFirstEdge_ - trackedLastEdge_) * 0.5;
+		double cosAngle = (d.x * dTracked.x + d.y * dTracked.y) / (length * trackedLength);
+		if ( (norm(centerOffset) < opts_.trackingTolerance * max(length, trackedLength)) && (abs(cosAngle) > minCosAngle) )
+		{
+			bool isSwapped = (cosAngle < 0);
+			trackedFirstEdge_ = (isSwapped ? bc.lastEdge : bc.firstEdge);
+			trackedLastEdge_ = (isSwapped ? bc.firstEdge : bc.lastEdge);
+			return isSwapped;
+		}
+		LOGD("Lost track of barcode, discarding the energies of %u frames\n", nFusedFrames_);
+		nFusedFrames_ = 0;
+	}
+	trackedFirstEdge_ = bc.firstEdge;
+	trackedLastEdge_ = bc.lastEdge;
+	return false;
+}
+
+string BarcodeDecoder::estimateFused(int dir)
+{
+	for (TUInt d = 0; d < nPatterns_; d++)
+	{
+		for (TUInt s = 0; s < nSymbols_; s++)
+			fusedEnergies_(d, s) = 0;
+	}
+	//Sum the newest nFusedFrames_ frames that were read in this direction, going back from the newest in the ring buffer
+	TUInt nFrames = 0;
+	for (TUInt n = 0, f = newestFusedFrame_; n < nFusedFrames_; n++, f = (f + fusedFrames_.size() - 1) % fusedFrames_.size())
+	{
+		if ( (fusedFrameDirections_[f] & (1 << dir)) == 0 )
+			continue;
+		nFrames++;
+		const TMatEnergy &frameEnergies = fusedFrames_[f][dir];
+		for (TUInt d = 0; d < nPatterns_; d++)
+		{
+			for (TUInt s = 0; s < nSymbols_; s++)
+				fusedEnergies_(d, s) += frameEnergies(d, s);
+		}
+	}
+	if (nFrames < 2)
+		return string();
+	LOGD("Attempting estimation of barcode as %s from the energies of %u frames:\n", symbology_->name(), nFrames);
+	return symbology_->estimate(fusedEnergies_);
+}
+
+void BarcodeDecoder::localizeScanline(TUInt k, Slices &slices)
+{
+	Scanline &scanline = scanlines_[k];
+	scanline.isLocalized = false;
+	if (mirroredLayout_)
+		mirroredScanlines_[k].isLocalized = false;
+	if (!slices.extract(k))
+		return;
+	//Skip the scanlines whose number of edges cannot come from this symbology
+	TUInt nEdges = slices.edges(k).size(), nSymbologyEdges = symbology_->nTotalEdges();
+	if ( (nEdges < nSymbologyEdges) || (nEdges > (1 + opts_.maxExtraEdges) * nSymbologyEdges) )
+	{
+		LOGD("Scanline %u has %u edges, which cannot be a %s barcode of %u edges\n", k, nEdges, symbology_->name(), nSymbologyEdges);
+		return;
+	}
+	scanline.slice = &slices.slice(k);
+	scanline.detectedEdges = &slices.edges(k);
+	//When fitting in batches, only the candidates are found here, and the prepared scanlines are fit together afterwards
+	scanline.isLocalized = (opts_.useBatchViterbi ? prepareFixedEdges(layout(FORWARD), scanline) : localizeFixedEdges(layout(FORWARD), scanline));
+	if (mirroredLayout_)
+	{
+		Scanline &mirroredScanline = mirroredScanlines_[k];
+		mirroredScanline.slice = scanline.slice;
+		mirroredScanline.detectedEdges = scanline.detectedEdges;
+		mirroredScanline.isLocalized = (opts_.useBatchViterbi ? prepareFixedEdges(layout(BACKWARD), mirroredScanline) :
+				localizeFixedEdges(layout(BACKWARD), mirroredScanline));
+	}
+}
+
+TUInt BarcodeDecoder::localizeScanlines(Slices &slices, TUInt (&nLocalized)[FINISHED])
+{
+	const TUInt nScanlines = scanlines_.size();
+	if ( (workers_ != NULL) && (nScanlines > 1) )
+		workers_->run(nScanlines, [this, &slices](TUInt k, TUInt /*worker*/) {localizeScanline(k, slices); });
+	else
+	{
+		for (TUInt k = 0; k < nScanlines; k++)
+			localizeScanline(k, slices);
+	}
+	if (opts_.useBatchViterbi)
+	{
+		fitFixedEdges(FORWARD);
+		if (mirroredLayout_)
+			fitFixedEdges(BACKWARD);
+	}
+	for (int dir = FORWARD; dir < FINISHED; dir++)
+	{
+		const vector<Scanline> &dirScanlines = scanlines(dir);
+		nLocalized[dir] = 0;
+		for (vector<Scanline>::const_iterator pScanline = dirScanlines.begin(); pScanline != dirScanlines.end(); pScanline++)
+			nLocalized[dir] += (pScanline->isLocalized ? 1 : 0);
+	}
+	LOGD("Localized the symbol boundaries of %u and %u of %u scanlines in the forward and backward directions\n", nLocalized[FORWARD], nLocalized[BACKWARD], nScanlines);
+	return max(nLocalized[FORWARD], nLocalized[BACKWARD]);
+}
+
+double BarcodeDecoder::matchSignature(Slices &slices)
+{
+	//The scanlines are shared by the decoders of the same width, the first decoder to match extracts them all
+	slices.extractAll(workers_);
+	//The same edge count test as localizeScanline(), so that the decoder is only skipped if no scanline would be localized
+	double bestDistance = -1;
+	for (TUInt k = 0; k < slices.nScanlines(); k++)
+	{
+		if (!slices.extract(k))
+			continue;
+		const vector<DetectedEdge> &edges = slices.edges(k);
+		TUInt nEdges = edges.size();
+		if ( (nEdges < signature_.nEdges) || (nEdges > (1 + opts_.maxExtraEdges) * signature_.nEdges) )
+			continue;
+		double distance = (nEdges - signature_.nEdges) / (double) signature_.nEdges + guardDistance(edges);
+		if ( (bestDistance < 0) || (distance < bestDistance) )
+			bestDistance = distance;
+	}
+	LOGD("Distance of the barcode from the signature of %s: %f\n", symbology_->name(), bestDistance);
+	return bestDistance;
+}
+
+double BarcodeDecoder::guardDistance(const vector<DetectedEdge> &edges)
+{
+	const vector<TUInt> &startGuard = signature_.startGuard, &endGuard = signature_.endGuard;
+	if (startGuard.empty() && endGuard.empty())
+		return 0;
+	//Only the edges about as strong as the strongest half of the edges of the symbology are bar edges, the others being noise
+	vector<int> &magnitudes = edgeMagnitudes_;
+	magnitudes.clear();
+	for (vector<DetectedEdge>::const_iterator pEdge = edges.begin(); pEdge != edges.end(); pEdge++)
+		magnitudes.push_back(pEdge->magnitude);
+	TUInt nStrongest = signature_.nEdges / 2;
+	nth_element(magnitudes.begin(), magnitudes.end() - nStrongest, magnitudes.end());
+	double minMagnitude = opts_.maxQuietZoneEdgeMagnitude * magnitudes[magnitudes.size() - nStrongest];
+	vector<double> &bars = guardBars_;
+	bars.clear();
+	double firstEdge = -1, prevEdge = -1;
+	for (vector<DetectedEdge>::const_iterator pEdge = edges.begin(); pEdge != edges.end(); pEdge++)
+	{
+		if (pEdge->magnitude < minMagnitude)
+			continue;
+		if (prevEdge >= 0)
+			bars.push_back(pEdge->location - prevEdge);
+		else
+			firstEdge = pEdge->location;
+		prevEdge = pEdge->location;
+	}
+	if (bars.size() < max(startGuard.size(), endGuard.size()))
+		return 0;
+	//Match the start guard at the beginning and the end guard at the end when reading forward, and the reverse backward
+	double minDistance = -1;
+	for (int dir = FORWARD; dir < FINISHED; dir++)
+	{
+		double distance = 0, sumX = 0;
+		TUInt nGuards = 0;
+		for (int end = 0; end < 2; end++)
+		{
+			bool isStart = ( (end == 0) == (dir == FORWARD) );
+			const vector<TUInt> &guard = (isStart ? startGuard : endGuard);
+			if (guard.empty())
+				continue;
+			//The guard bars in the order they are read
+			TUInt nBars = guard.size(), guardWidth = 0;
+			const double *guardBars = (end == 0 ? &bars[0] : &bars[bars.size() - nBars]);
+			double barsWidth = 0;
+			for (TUInt i = 0; i < nBars; i++)
+			{
+				guardWidth += guard[i];
+				barsWidth += guardBars[i];
+			}
+			double x = barsWidth / guardWidth, barDistance = 0;
+			for (TUInt i = 0; i < nBars; i++)
+				barDistance += abs(guardBars[dir == FORWARD ? i : nBars - 1 - i] / x - guard[i]);
+			distance += barDistance / nBars;
+			sumX += x;
+			nGuards++;
+		}
+		double x = sumX / nGuards, width = (prevEdge - firstEdge) / x;
+		distance += abs(width - signature_.width) / signature_.width;
+		if ( (minDistance < 0) || (distance < minDistance) )
+			minDistance = distance;
+	}
+	return minDistance;
+}
+
+bool BarcodeDecoder::Slices::extractIntegralSlice(const TMatrixUInt8& aImg, TPointInt firstEdge, TPointInt lastEdge, vector<int> &slice) const
 {
 	//for each TPointInt on this slice
-	double fundamentalWidth = norm(lastEdge - firstEdge) / symbology_->width();
+	double fundamentalWidth = norm(lastEdge - firstEdge) / width_;
 	double scaling = (double) opts_.fundamentalWidth / fundamentalWidth;
 	TPointDouble d = lastEdge - firstEdge;
 	double theta = atan2(d.y, d.x);
@@ -145,70 +538,81 @@ void BarcodeDecoder::extractIntegralSlice(const TMatrixUInt8& aImg, TPointInt fi
 	//extend 2X past the first and last edges.
 	firstEdge -= offset;
 	lastEdge += offset;
+	//The interpolation reads one pixel to the right and below each sample
+	if ( (min(firstEdge.x, lastEdge.x) < 0) || (min(firstEdge.y, lastEdge.y) < 0)
+			|| (max(firstEdge.x, lastEdge.x) + 1 >= (int) aImg.cols) || (max(firstEdge.y, lastEdge.y) + 1 >= (int) aImg.rows) )
+		return false;
 	//Recalculate step and scaling to account for quantization
 	d = lastEdge - firstEdge;
 	theta = atan2(d.y, d.x);
-	scaling = (double) slice_.size() / norm(d);
-	TPointDouble step(cos(theta) / scaling, sin(theta) / scaling);
-	TPointDouble pt((double) firstEdge.x, (double) firstEdge.y);
-	TPointInt qt; //quantized version of pt
-	slice_.front() = aImg(firstEdge);
-	slice_.back() = aImg(lastEdge);
-	vector<int>::iterator s = slice_.begin();
-	for (s++; s != slice_.end() - 1; s++)
+	scaling = (double) slice.size() / norm(d);
+	//Step along the slice in 32.32 fixed point so that the rounding of the step does not accumulate, interpolating with 16 bit weights
+	static const int FRACTION_BITS = 32;
+	static const TInt64 FIXED_ONE = ((TInt64) 1) << FRACTION_BITS;
+	const TInt64 stepX = (TInt64) floor(cos(theta) / scaling * FIXED_ONE + 0.5), stepY = (TInt64) floor(sin(theta) / scaling * FIXED_ONE + 0.5);
+	TInt64 ptX = firstEdge.x * FIXED_ONE, ptY = firstEdge.y * FIXED_ONE;
+	slice.front() = aImg(firstEdge);
+	slice.back() = aImg(lastEdge);
+	//The sum keeps the fractions of the samples, and is only rounded when stored
+	static const TInt64 FIXED_HALF = FIXED_ONE / 2;
+	int *s = slice.data(), *sEnd = s + slice.size() - 1;
+	TInt64 sum = *s * FIXED_ONE;
+	for (s++; s != sEnd; s++)
 	{
-		pt += step;
-		qt.x = floor(pt.x);
-		qt.y = floor(pt.y);
-		double dx = pt.x - qt.x;
-		double dy = pt.y - qt.y;
+		ptX += stepX;
+		ptY += stepY;
+		//Rows are addressed directly, the slice is within the image so no bounds checks are needed
+		const int x = (int) (ptX >> FRACTION_BITS), y = (int) (ptY >> FRACTION_BITS);
+		const TUInt8 *row0 = aImg[y] + x, *row1 = aImg[y + 1] + x;
+		const int wx = (int) ((ptX & (FIXED_ONE - 1)) >> (FRACTION_BITS - 16)), wy = (int) ((ptY & (FIXED_ONE - 1)) >> (FRACTION_BITS - 16));
 		//Interpolate & integrate
-		*s = (1-dy) * ((1-dx) * aImg(qt) + dx * aImg(qt.y, qt.x+1)) \
-				+ dy * ((1-dx) * aImg(qt.y+1, qt.x) + dx * aImg(qt.y+1, qt.x+1)) \
-				+ *(s-1);
+		const int top = (row0[0] << 16) + wx * (row0[1] - row0[0]), bottom = (row1[0] << 16) + wx * (row1[1] - row1[0]);
+		sum += ((TInt64) top << 16) + (TInt64) wy * (bottom - top);
+		*s = (int) ((sum + FIXED_HALF) >> FRACTION_BITS);
 	}
-	//Last TPointInt. Now, s -> slice_.end() - 1 = slice.back();
-	*s += *(s-1);
+	//Last TPointInt. Now, s -> slice.end() - 1 = slice.back();
+	*s += *(s - 1);
+	return true;
 }
 
-void BarcodeDecoder::extractEdges(vector<DetectedEdge> &edges)
+void BarcodeDecoder::Slices::extractEdges(const vector<int> &slice, vector<DetectedEdge> &edges) const
 {
 	edges.clear();
-	static const TUInt width = opts_.fundamentalWidth / 2; //for edge filter
+	const TUInt width = opts_.fundamentalWidth / 2; //for edge filter
 	TUInt nPrevPos = 0, nPrevNeg = 0;
 	int ePrev = 0, e, eNext;
-	vector<int>::iterator i = slice_.begin() + width;
+	vector<int>::const_iterator i = slice.begin() + width;
 	e = *(i + width) + *(i - width) - 2 * (*i);
 
-	for (i++; i != slice_.end() - width - 1; i++)
+	for (i++; i != slice.end() - width - 1; i++)
 	{
 		eNext = *(i + width) + *(i - width) - 2 * (*i);
 		if ( (e > opts_.edgeThresh) && (e > ePrev) && (e >= eNext ) ) 			//if it's a local max
-			edges.push_back( DetectedEdge(1, i - slice_.begin() - 1, e, nPrevPos++, nPrevNeg) );
+			edges.push_back( DetectedEdge(1, i - slice.begin() - 1 + 0.5 * (ePrev - eNext) / (ePrev - 2 * e + eNext), e, nPrevPos++, nPrevNeg) );
 		else if ( (e < -opts_.edgeThresh) && (e < ePrev) && (e <= eNext) ) 		//if it's a local min
-			edges.push_back( DetectedEdge(-1, i - slice_.begin() - 1, -e, nPrevPos, nPrevNeg++) );
+			edges.push_back( DetectedEdge(-1, i - slice.begin() - 1 + 0.5 * (ePrev - eNext) / (ePrev - 2 * e + eNext), -e, nPrevPos, nPrevNeg++) );
 		ePrev = e;
 		e = eNext;
 	}
 }
 
-bool BarcodeDecoder::localizeFixedEdges(vector<SymbolBoundary> &symbolBoundaries)
+bool BarcodeDecoder::prepareFixedEdges(const BarcodeSymbology::FlatLayout &aLayout, Scanline &scanline) const
 {
-	//extract edges from barcode strip
-	static vector<DetectedEdge> detectedEdges;
-	detectedEdges.reserve(100);	//reserve space assuming no more than 100 edges detected (if more, the array may move)
-	extractEdges(detectedEdges);
+	//edges are extracted from the barcode strip with the slice
+	const vector<DetectedEdge> &detectedEdges = *scanline.detectedEdges;
+	if (detectedEdges.empty())
+		return false;
 	//get edge candidates
-	static TUInt nFixedEdges = symbology_->nFixedEdges();
-	static vector<vector<TEnergy> > priors(nFixedEdges);
-	static vector<TMatEnergy> conditionals(nFixedEdges-1, TMatEnergy(0,0));
+	const TUInt nFixedEdges = aLayout.nFixedEdges();
+	vector<vector<TEnergy> > &priors = scanline.priors;
+	vector<TMatEnergy> &conditionals = scanline.conditionals;
 	//Get list of fixed edge candidates among detected edges
-	static vector<vector<const DetectedEdge*> > fixedEdgeCandidates(nFixedEdges); //fixedEdgeCandidates[i] has pointers to detected edges that may be fixed edge i
-	if (!getFixedEdgeCandidates(detectedEdges, fixedEdgeCandidates))
+	vector<vector<const DetectedEdge*> > &fixedEdgeCandidates = scanline.fixedEdgeCandidates;
+	if (!getFixedEdgeCandidates(aLayout, detectedEdges, fixedEdgeCandidates))
 		return false;
-	//Determine fixed edge locations
-	double xInit, x = ((double) (fixedEdgeCandidates.back().back()->location - fixedEdgeCandidates.front().front()->location) ) / symbology_->width();
-	//Resize the prior and conditional matrices
+	//Initial estimate of the fundamental width
+	scanline.fitWidth = (fixedEdgeCandidates.back().back()->location - fixedEdgeCandidates.front().front()->location) / aLayout.width;
+	//Resize the prior and conditional matrices, growing the conditional buffers only if they are too small
 	for (TUInt n = 0; n < nFixedEdges; n++)
 	{
 		TUInt M = fixedEdgeCandidates[n].size();
@@ -216,23 +620,52 @@ bool BarcodeDecoder::localizeFixedEdges(vector<SymbolBoundary> &symbolBoundaries
 		if (n < nFixedEdges-1)
 		{
 			TUInt N = fixedEdgeCandidates[n+1].size();
-			conditionals[n] = TMatEnergy(M, N);
+			TMatEnergy &buffer = scanline.conditionalBuffers[n];
+			if ( (M > (TUInt) buffer.rows) || (N > (TUInt) buffer.cols) )
+				buffer = TMatEnergy(max(M, (TUInt) buffer.rows), max(N, (TUInt) buffer.cols));
+			conditionals[n] = buffer(TRectUInt(0, 0, N, M));
 		}
 	}
-	//Prepare the viterbi
-	Viterbi<TEnergy> V(priors, conditionals);
+	return true;
+}
+
+bool BarcodeDecoder::localizeFixedEdges(const BarcodeSymbology::FlatLayout &aLayout, Scanline &scanline) const
+{
+	if (!prepareFixedEdges(aLayout, scanline))
+		return false;
+	vector<vector<TEnergy> > &priors = scanline.priors;
+	vector<TMatEnergy> &conditionals = scanline.conditionals;
+	const vector<vector<const DetectedEdge*> > &fixedEdgeCandidates = scanline.fixedEdgeCandidates;
+	//Determine fixed edge locations
+	double xInit, x = scanline.fitWidth;
+	//Prepare the viterbi, only considering the transitions within the bands if the search is banded
+	bool isBanded = (opts_.edgeSearchTolerance > 0);
+	if (!scanline.viterbi)
+		scanline.viterbi.reset(new Viterbi<TEnergy>(priors, conditionals, 1, (isBanded ? &scanline.bands : NULL)));
+	Viterbi<TEnergy> &V = *scanline.viterbi;
+	TUInt nIterations = 0;
 	do
 	{
+		if (nIterations++ == opts_.maxFitIterations)
+		{
+			LOGD("Fundamental width estimate did not converge in %u iterations\n", opts_.maxFitIterations);
+			return false;
+		}
 		LOGD("x estimated = %f\n", x);
 		xInit = x;
 		//Calculate energies
-		calculateFixedEdgeEnergies(fixedEdgeCandidates, x, priors, conditionals);
+		calculateFixedEdgeEnergies(aLayout, fixedEdgeCandidates, x, priors, conditionals, scanline.bands);
 		//Perform the Viterbi
 		try
 		{
 			V.solve();
+			if (isBanded && (V.solutions[0].energy >= ski::MaxValue<TEnergy>() / 4))
+			{
+				LOGD("No fit of the fixed edges within the search tolerance\n");
+				return false;
+			}
 			vector<int> &bestFitEdges = V.solutions[0].sequence;
-			x = ((double) (fixedEdgeCandidates.back()[bestFitEdges.back()]->location - fixedEdgeCandidates.front()[bestFitEdges.front()]->location )) / symbology_->width();
+			x = (fixedEdgeCandidates.back()[bestFitEdges.back()]->location - fixedEdgeCandidates.front()[bestFitEdges.front()]->location) / aLayout.width;
 		}
 		catch (exception &aErr)
 		{
@@ -241,39 +674,159 @@ bool BarcodeDecoder::localizeFixedEdges(vector<SymbolBoundary> &symbolBoundaries
 		}
 	}
 	while (abs(x-xInit) > 0.01 * x);	//repeat until convergence (to 1%) of the fundamental width.
+	scanline.fitEnergy = V.solutions[0].energy;
+	scanline.fitWidth = x;
+	return checkFixedEdges(aLayout, scanline, V.solutions[0].sequence, x);
+}
+
+bool BarcodeDecoder::checkFixedEdges(const BarcodeSymbology::FlatLayout &aLayout, Scanline &scanline, const vector<int> &bestFitEdges, double x) const
+{
+	const vector<DetectedEdge> &detectedEdges = *scanline.detectedEdges;
+	const vector<vector<const DetectedEdge*> > &fixedEdgeCandidates = scanline.fixedEdgeCandidates;
+	const TUInt nFixedEdges = aLayout.nFixedEdges();
+	//Reject the fit if the bars continue past the first or last fixed edge, as when part of a longer barcode fits the layout,
+	//or if there are more bar edges between them than in the layout, as when the layout is stretched over a longer barcode.
+	//The other edges detected are only noise, much weaker than the fixed edges.
+	int minFixedEdgeMagnitude = ski::MaxValue<int>();
+	for (TUInt n = 0; n < nFixedEdges; n++)
+		minFixedEdgeMagnitude = min(minFixedEdgeMagnitude, fixedEdgeCandidates[n][bestFitEdges[n]]->magnitude);
+	double firstEdge = fixedEdgeCandidates.front()[bestFitEdges.front()]->location - 0.5 * x;
+	double lastEdge = fixedEdgeCandidates.back()[bestFitEdges.back()]->location + 0.5 * x;
+	TUInt nBarEdges = 0;
+	for (vector<DetectedEdge>::const_iterator pEdge = detectedEdges.begin(); pEdge != detectedEdges.end(); pEdge++)
+	{
+		if (pEdge->magnitude <= opts_.maxQuietZoneEdgeMagnitude * minFixedEdgeMagnitude)
+			continue;
+		if ( (pEdge->location < firstEdge) || (pEdge->location > lastEdge) )
+		{
+			LOGD("Bar edge found in the quiet zone of the %s layout, which may be part of a longer barcode\n", aLayout.name);
+			return false;
+		}
+		nBarEdges++;
+	}
+	if (nBarEdges > aLayout.nTotalEdges + opts_.maxExtraBarEdges)
+	{
+		LOGD("%u bar edges found within the %s layout of %u edges\n", nBarEdges, aLayout.name, aLayout.nTotalEdges);
+		return false;
+	}
 	//Return the symbol boundaries:
+	vector<SymbolBoundary> &symbolBoundaries = scanline.boundaries;
 	symbolBoundaries.resize(nSymbols_);
-	vector<int> &bestFitEdges = V.solutions[0].sequence;
-	for (TUInt s = 0, e = 0; s < nSymbols_; s++)
-	{
-		const BarcodeSymbology::Symbol* aSymbol = symbology_->getDataSymbol(s);
-		symbolBoundaries[s].width = aSymbol->width;
-		const BarcodeSymbology::Edge* aEdge = aSymbol->leftEdge();
-		//Find the corresponding fixed edge index
-		while (symbology_->getFixedEdge(e) != aEdge)
-			e++;
-		symbolBoundaries[s].leftEdge = fixedEdgeCandidates[e][bestFitEdges[e]]->location;
-		aEdge = aSymbol->rightEdge();
-		//Find the corresponding fixed edge index
-		while (symbology_->getFixedEdge(e) != aEdge)
-			e++;
-		symbolBoundaries[s].rightEdge = fixedEdgeCandidates[e][bestFitEdges[e]]->location;
+	for (TUInt s = 0; s < nSymbols_; s++)
+	{
+		TUInt left = aLayout.symbolLeftFixedEdges[s], right = aLayout.symbolRightFixedEdges[s];
+		symbolBoundaries[s].width = aLayout.symbolWidths[s];
+		symbolBoundaries[s].leftEdge = fixedEdgeCandidates[left][bestFitEdges[left]]->location;
+		symbolBoundaries[s].rightEdge = fixedEdgeCandidates[right][bestFitEdges[right]]->location;
 	}
 	return true;
 }
 
-void BarcodeDecoder::calculateFixedEdgeEnergies(const vector<vector<const DetectedEdge*> > &fixedEdgeCandidates,
-		double x, vector<vector<TEnergy> > &priors, vector<TMatEnergy> &conditionals)
+void BarcodeDecoder::fitFixedEdges(int dir)
+{
+	const BarcodeSymbology::FlatLayout &aLayout = layout(dir);
+	const TUInt nFixedEdges = aLayout.nFixedEdges();
+	const bool isBanded = (opts_.edgeSearchTolerance > 0);
+	const TEnergy impossible = ski::MaxValue<TEnergy>() / 2;
+	vector<Scanline> &dirScanlines = scanlines(dir);
+	fittingScanlines_.clear();
+	for (vector<Scanline>::iterator pScanline = dirScanlines.begin(); pScanline != dirScanlines.end(); pScanline++)
+	{
+		if (pScanline->isLocalized)
+			fittingScanlines_.push_back(&(*pScanline));
+	}
+	for (TUInt nIterations = 0; !fittingScanlines_.empty(); nIterations++)
+	{
+		if (nIterations == opts_.maxFitIterations)
+		{
+			LOGD("Fundamental width estimates of %u scanlines did not converge in %u iterations\n", (TUInt) fittingScanlines_.size(), opts_.maxFitIterations);
+			for (vector<Scanline*>::iterator pScanline = fittingScanlines_.begin(); pScanline != fittingScanlines_.end(); pScanline++)
+				(*pScanline)->isLocalized = false;
+			break;
+		}
+		//Pad the chains to the most candidates of any scanline for each fixed edge
+		const TUInt nChains = fittingScanlines_.size();
+		batchStates_.assign(nFixedEdges, 1);
+		for (TUInt b = 0; b < nChains; b++)
+		{
+			for (TUInt n = 0; n < nFixedEdges; n++)
+				batchStates_[n] = max(batchStates_[n], (int) fittingScanlines_[b]->fixedEdgeCandidates[n].size());
+		}
+		fixedEdgeBatch_.resize(nChains, batchStates_);
+		for (TUInt b = 0; b < nChains; b++)
+		{
+			Scanline &scanline = *fittingScanlines_[b];
+			const vector<vector<const DetectedEdge*> > &fixedEdgeCandidates = scanline.fixedEdgeCandidates;
+			calculateFixedEdgeEnergies(aLayout, fixedEdgeCandidates, scanline.fitWidth, scanline.priors, scanline.conditionals, scanline.bands);
+			//The padded candidates and the transitions outside the bands are impossible
+			for (TUInt n = 0; n < nFixedEdges; n++)
+			{
+				int M = fixedEdgeCandidates[n].size();
+				for (int i = 0; i < batchStates_[n]; i++)
+					fixedEdgeBatch_.prior(n, i)[b] = (i < M ? scanline.priors[n][i] : impossible);
+			}
+			for (TUInt n = 1; n < nFixedEdges; n++)
+			{
+				int M = fixedEdgeCandidates[n-1].size(), N = fixedEdgeCandidates[n].size();
+				const TMatEnergy &conditional = scanline.conditionals[n-1];
+				for (int i = 0; i < batchStates_[n-1]; i++)
+				{
+					for (int j = 0; j < batchStates_[n]; j++)
+					{
+						bool isPossible = ( (i < M) && (j < N) && ( !isBanded || ( (i >= scanline.bands[n-1][j].first) && (i < scanline.bands[n-1][j].second) ) ) );
+						fixedEdgeBatch_.conditional(n, i, j)[b] = (isPossible ? conditional(i, j) : impossible);
+					}
+				}
+			}
+		}
+		try
+		{
+			fixedEdgeBatch_.solve();
+		}
+		catch (exception &aErr)
+		{
+			LOGE("Error in fixed edge calculation: %s\n", aErr.what());
+			throw;
+		}
+		//Update the fundamental width estimates, keeping only the scanlines that have not converged yet in the batch
+		TUInt nFitting = 0;
+		for (TUInt b = 0; b < nChains; b++)
+		{
+			Scanline &scanline = *fittingScanlines_[b];
+			const BatchViterbi<TEnergy>::Solution &fit = fixedEdgeBatch_.solutions[b];
+			if (isBanded && (fit.energy >= ski::MaxValue<TEnergy>() / 4))
+			{
+				LOGD("No fit of the fixed edges within the search tolerance\n");
+				scanline.isLocalized = false;
+				continue;
+			}
+			const vector<vector<const DetectedEdge*> > &fixedEdgeCandidates = scanline.fixedEdgeCandidates;
+			double xInit = scanline.fitWidth, x = (fixedEdgeCandidates.back()[fit.sequence.back()]->location -
+					fixedEdgeCandidates.front()[fit.sequence.front()]->location) / aLayout.width;
+			scanline.fitWidth = x;
+			if (abs(x-xInit) > 0.01 * x)	//repeat until convergence (to 1%) of the fundamental width.
+			{
+				fittingScanlines_[nFitting++] = &scanline;
+				continue;
+			}
+			scanline.fitEnergy = fit.energy;
+			scanline.isLocalized = checkFixedEdges(aLayout, scanline, fit.sequence, x);
+		}
+		fittingScanlines_.resize(nFitting);
+	}
+}
+
+void BarcodeDecoder::calculateFixedEdgeEnergies(const BarcodeSymbology::FlatLayout &aLayout, const vector<vector<const DetectedEdge*> > &fixedEdgeCandidates,
+		double x, vector<vector<TEnergy> > &priors, vector<TMatEnergy> &conditionals, vector<vector<pair<int, int> > > &bands) const
 {
 	TEnergy energy;
-	const BarcodeSymbology::Edge *pEdge, *pNextEdge;
-	static const double coeffPrior = 1 / opts_.edgeFixedLocationVar, coeffConditional = 1 / opts_.edgeRelativeLocationVar;
+	const int *fixedEdgeLocations = &aLayout.fixedEdgeLocations[0];
+	const double coeffPrior = 1 / opts_.edgeFixedLocationVar, coeffConditional = 1 / opts_.edgeRelativeLocationVar;
 	//Priors
-	static const TUInt nFixedEdges = symbology_->nFixedEdges();
+	const TUInt nFixedEdges = aLayout.nFixedEdges();
 	for (TUInt n = 0; n < nFixedEdges; n++)
 	{
-		pEdge = symbology_->getFixedEdge(n);
-		double expectedEdgeLocation = 1 + pEdge->location;
+		double expectedEdgeLocation = sliceMargin_ - 1 + fixedEdgeLocations[n];
 		TUInt M = fixedEdgeCandidates[n].size();
 		//priors[n].resize(M);
 		TEnergy *pPrior = &(priors[n].front());
@@ -292,11 +845,34 @@ void BarcodeDecoder::calculateFixedEdgeEnergies(const vector<vector<const Detect
 	//Conditionals
 	for (TUInt n = 0; n < nFixedEdges-1; n++)
 	{
-		pEdge = symbology_->getFixedEdge(n);
-		pNextEdge = symbology_->getFixedEdge(n+1);
-		double expectedInterEdgeDistance = pNextEdge->location - pEdge->location;
+		double expectedInterEdgeDistance = fixedEdgeLocations[n+1] - fixedEdgeLocations[n];
 		TUInt M = fixedEdgeCandidates[n].size(), N = fixedEdgeCandidates[n+1].size();
-		conditionals[n] = TMatEnergy(M, N);
+		if (opts_.edgeSearchTolerance > 0)
+		{
+			//Candidates are ordered by location, so the candidates at an acceptable distance before each next candidate form
+			//a contiguous range that moves forward with the next candidate.
+			const vector<const DetectedEdge*> &candidates = fixedEdgeCandidates[n];
+			double minDistance = max(expectedInterEdgeDistance - opts_.edgeSearchTolerance, 0.0) * x;
+			double maxDistance = (expectedInterEdgeDistance + opts_.edgeSearchTolerance) * x;
+			bands[n].resize(N);
+			TUInt first = 0, last = 0;
+			for (TUInt j = 0; j < N; j++)
+			{
+				const DetectedEdge *pNextE = fixedEdgeCandidates[n+1][j];
+				while ( (first < M) && (pNextE->location - candidates[first]->location > maxDistance) )
+					first++;
+				last = max(first, last);
+				while ( (last < M) && (pNextE->location - candidates[last]->location >= minDistance) && (pNextE->location > candidates[last]->location) )
+					last++;
+				bands[n][j] = pair<int, int>(first, last);
+				for (TUInt i = first; i < last; i++)
+				{
+					double distanceFromExpected = abs(expectedInterEdgeDistance - (pNextE->location - candidates[i]->location) / x);
+					conditionals[n](i, j) = coeffConditional * distanceFromExpected * distanceFromExpected;
+				}
+			}
+			continue;
+		}
 		for (TUInt i = 0; i < M; i++)
 		{
 			const DetectedEdge *pE = fixedEdgeCandidates[n][i];
@@ -318,10 +894,11 @@ void BarcodeDecoder::calculateFixedEdgeEnergies(const vector<vector<const Detect
 	}
 }
 
-bool BarcodeDecoder::getFixedEdgeCandidates(const vector<DetectedEdge> &detectedEdges, vector<vector<const DetectedEdge*> > &fixedEdgeCandidates)
+bool BarcodeDecoder::getFixedEdgeCandidates(const BarcodeSymbology::FlatLayout &aLayout, const vector<DetectedEdge> &detectedEdges,
+		vector<vector<const DetectedEdge*> > &fixedEdgeCandidates) const
 {
-	static const int nPositiveEdges = symbology_->nTotalEdges() / 2, nNegativeEdges = symbology_->nTotalEdges() / 2;
-	static const TUInt nFixedEdges = symbology_->nFixedEdges();
+	const int nPositiveEdges = aLayout.nTotalEdges / 2, nNegativeEdges = aLayout.nTotalEdges / 2;
+	const TUInt nFixedEdges = aLayout.nFixedEdges();
 	const DetectedEdge *lastEdge = &(detectedEdges.back());
 	int nDetectedPositiveEdges = (lastEdge->polarity == 1 ? lastEdge->nPreviousPositiveEdges + 1 : lastEdge->nPreviousPositiveEdges);
 	int nDetectedNegativeEdges = (lastEdge->polarity == -1 ? lastEdge->nPreviousNegativeEdges + 1 : lastEdge->nPreviousNegativeEdges);
@@ -331,10 +908,10 @@ bool BarcodeDecoder::getFixedEdgeCandidates(const vector<DetectedEdge> &detected
 	vector<DetectedEdge>::const_iterator pFirstCandidate = detectedEdges.begin();
 	for (TUInt n = 0; n < nFixedEdges; n++)
 	{
-		const BarcodeSymbology::Edge *pEdge = symbology_->getFixedEdge(n);
+		const int polarity = aLayout.fixedEdgePolarities[n];
 		pCandidates->clear();
-		int minNegEdges = pEdge->nPreviousNegativeEdges(), maxNegEdges = pEdge->nPreviousNegativeEdges() + nRemainingNegativeEdges;
-		int minPosEdges = pEdge->nPreviousPositiveEdges(), maxPosEdges = pEdge->nPreviousPositiveEdges() + nRemainingPositiveEdges;
+		int minNegEdges = aLayout.nPreviousNegativeEdges(n), maxNegEdges = minNegEdges + nRemainingNegativeEdges;
+		int minPosEdges = aLayout.nPreviousPositiveEdges(n), maxPosEdges = minPosEdges + nRemainingPositiveEdges;
 		while ( (pFirstCandidate->nPreviousNegativeEdges < minNegEdges) || (pFirstCandidate->nPreviousPositiveEdges < minPosEdges) )
 			pFirstCandidate++;	//keep track of first possible edge candidate so as not to iterate from the beginning
 		//Find which edges are possible candidates
@@ -344,7 +921,7 @@ bool BarcodeDecoder::getFixedEdgeCandidates(const vector<DetectedEdge> &detected
 			if ( (pDetectedEdge->nPreviousNegativeEdges > maxNegEdges) || (pDetectedEdge->nPreviousPositiveEdges > maxPosEdges) )
 				break;	//no further candidates past this TPointInt
 			//pDetectedEdge at this point has the appropriate number of previous and consecutive edges, now we check its polarity
-			if ( pDetectedEdge->polarity == pEdge->polarity() )
+			if ( pDetectedEdge->polarity == polarity )
 				pCandidates->push_back(&(*pDetectedEdge));
 		}
 		if (pCandidates->empty()) //no candidates found -> it is not possible to fit a barcode to the detected edges
@@ -354,51 +931,283 @@ bool BarcodeDecoder::getFixedEdgeCandidates(const vector<DetectedEdge> &detected
 	return true;	//there is a possible fit
 }
 
-void BarcodeDecoder::getDigitEnergies(int dir, const vector<SymbolBoundary> &boundaries)
+int BarcodeDecoder::inferDirection() const
+{
+	int nForwardVotes = 0, nBackwardVotes = 0;
+	if (mirroredLayout_)
+	{
+		//Each scanline of an asymmetric symbology votes for the direction whose layout fits its edges clearly better,
+		//the guard bands of the other layout landing on the wrong edges.
+		static const double minFitRatio = 2;
+		for (TUInt k = 0; k < mirroredScanlines_.size(); k++)
+		{
+			const Scanline &forward = scanlines_[k], &backward = mirroredScanlines_[k];
+			if (forward.isLocalized && (!backward.isLocalized || (minFitRatio * forward.fitEnergy < backward.fitEnergy)) )
+				nForwardVotes++;
+			else if (backward.isLocalized && (!forward.isLocalized || (minFitRatio * backward.fitEnergy < forward.fitEnergy)) )
+				nBackwardVotes++;
+		}
+		LOGD("Direction votes from the layout fits: %d forward, %d backward\n", nForwardVotes, nBackwardVotes);
+		return (nForwardVotes > nBackwardVotes ? FORWARD : (nBackwardVotes > nForwardVotes ? BACKWARD : FINISHED));
+	}
+	//Each data symbol votes against a direction in which it should have the other parity.
+	//A parity that depends on the digit tells nothing about its direction.
+	for (vector<Scanline>::const_iterator pScanline = scanlines_.begin(); pScanline != scanlines_.end(); pScanline++)
+	{
+		if (!pScanline->isLocalized)
+			continue;
+		const vector<DetectedEdge> &edges = *pScanline->detectedEdges;
+		vector<DetectedEdge>::const_iterator pEdge = edges.begin();
+		for (TUInt s = 0; s < nSymbols_; s++)
+		{
+			int forwardParity = symbology_->darkModuleParity(s), backwardParity = symbology_->darkModuleParity(nSymbols_ - 1 - s);
+			if (forwardParity == backwardParity)
+				continue;
+			//Measure the dark width from the detected edges within the symbol, which must match the bars of the symbol
+			const BarcodeSymbology::FlatLayout &aLayout = layout(FORWARD);
+			const TUInt nBars = aLayout.nSymbolBars(s);
+			const SymbolBoundary &boundary = pScanline->boundaries[s];
+			double x = boundary.fundamentalWidth(), darkWidth = 0, barStart = boundary.leftEdge;
+			while ( (pEdge != edges.end()) && (pEdge->location < boundary.leftEdge + 0.5 * x) )
+				pEdge++;
+			TUInt b = 0;
+			bool isMatched = true;
+			for (; (pEdge != edges.end()) && (pEdge->location < boundary.rightEdge - 0.5 * x); pEdge++, b++)
+			{
+				if ( (b + 1 >= nBars) || (pEdge->polarity != (aLayout.isSymbolBarDark(s, b + 1) ? -1 : 1)) )
+					isMatched = false;
+				else
+				{
+					if (aLayout.isSymbolBarDark(s, b))
+						darkWidth += pEdge->location - barStart;
+					barStart = pEdge->location;
+				}
+			}
+			if ( !isMatched || (b + 1 != nBars) )
+				continue;
+			if (aLayout.isSymbolBarDark(s, nBars - 1))
+				darkWidth += boundary.rightEdge - barStart;
+			int parity = ((int) floor(darkWidth / x + 0.5)) % 2;
+			nForwardVotes += ( (backwardParity != -1) && (parity != backwardParity) ? 1 : 0);
+			nBackwardVotes += ( (forwardParity != -1) && (parity != forwardParity) ? 1 : 0);
+		}
+	}
+	LOGD("Direction votes: %d forward, %d backward\n", nForwardVotes, nBackwardVotes);
+	if (nForwardVotes >= 2 * nBackwardVotes + 2)
+		return FORWARD;
+	else if (nBackwardVotes >= 2 * nForwardVotes + 2)
+		return BACKWARD;
+	return FINISHED;
+}
+
+void BarcodeDecoder::initConvolutionWeights()
+{
+	vector<double> pattern;
+	for (int dir = FORWARD; dir < FINISHED; dir++)
+	{
+		TMatrixDouble weights(0, 0);
+		for (TUInt d = 0; d < nPatterns_; d++)	//for all possible patterns
+		{
+			//Get the pattern in fundamental widths
+			symbology_->getConvolutionPattern(d, 1.0, dir == BACKWARD, pattern);
+			TUInt nModules = (TUInt) floor(pattern.back() + 0.5);
+			if (weights.rows == 0)
+				weights = TMatrixDouble(nModules + 1, nPatterns_, 0.0);
+			else if (weights.rows != nModules + 1)
+				throw logic_error("BarcodeDecoder: convolution patterns must all have the same width");
+			//Each segment of the pattern adds its sign times the slice integral over it, and the mean times its signed width is removed
+			int sgn = 1, prevModule = 0, patternSum = 0;
+			for (vector<double>::const_iterator j = pattern.begin(); j != pattern.end(); j++, sgn *= -1)
+			{
+				int module = (int) floor(*j + 0.5);
+				if (fabs(*j - module) > 1e-6)
+					throw logic_error("BarcodeDecoder: convolution pattern edges must fall on whole fundamental widths");
+				weights(module, d) += sgn;
+				weights(prevModule, d) -= sgn;
+				patternSum += sgn * (module - prevModule);
+				prevModule = module;
+			}
+			weights(nModules, d) -= patternSum / (double) nModules;
+			weights(0, d) += patternSum / (double) nModules;
+			//Normalize by the width of the pattern
+			for (TUInt k = 0; k <= nModules; k++)
+				weights(k, d) /= nModules;
+		}
+		convolutionWeights_.push_back(weights);
+	}
+}
+
+void BarcodeDecoder::getDigitEnergies(int dir)
+{
+	vector<Scanline> &dirScanlines = scanlines(dir);
+	for (vector<Scanline>::iterator pScanline = dirScanlines.begin(); pScanline != dirScanlines.end(); pScanline++)
+	{
+		if (pScanline->isLocalized)
+			getDigitEnergies(dir, *pScanline);
+	}
+	//Combine the energies of the localized scanlines
+	for (TUInt d = 0; d < nPatterns_; d++)
+	{
+		for (TUInt s = 0; s < nSymbols_; s++)
+		{
+			scanlineEnergies_.clear();
+			for (vector<Scanline>::const_iterator pScanline = dirScanlines.begin(); pScanline != dirScanlines.end(); pScanline++)
+			{
+				if (pScanline->isLocalized)
+					scanlineEnergies_.push_back(pScanline->energies(d, s));
+			}
+			if (opts_.useScanlineMedian)
+			{
+				//Median, averaging the middle two for an even number of scanlines
+				TUInt n = scanlineEnergies_.size(), mid = n / 2;
+				nth_element(scanlineEnergies_.begin(), scanlineEnergies_.begin() + mid, scanlineEnergies_.end());
+				TEnergy median = scanlineEnergies_[mid];
+				if (n % 2 == 0)
+					median = (median + *max_element(scanlineEnergies_.begin(), scanlineEnergies_.begin() + mid)) / 2;
+				energies_[dir](d, s) = median;
+			}
+			else
+			{
+				TEnergy sum = 0;
+				for (vector<TEnergy>::const_iterator e = scanlineEnergies_.begin(); e != scanlineEnergies_.end(); e++)
+					sum += *e;
+				energies_[dir](d, s) = sum;
+			}
+		}
+	}
+}
+
+void BarcodeDecoder::getDigitEnergies(int dir, Scanline &scanline) const
 {
-	//Convolve the barcode symbol with the patterns to get digit energies.
-	vector<TUInt> pattern(6);
-	//Calculate patterns and convolve
+	const vector<SymbolBoundary> &boundaries = scanline.boundaries;
+	const TMatrixDouble &weights = convolutionWeights_[dir];
+	const int *data = scanline.slice->data();
+	vector<double> &samples = scanline.samples;
+	samples.resize(weights.rows);
+	double *conv = &scanline.convolutions[0];
 	bool isBackwards = (dir == BACKWARD);
+	const BarcodeSymbology::FlatLayout &dirLayout = layout(dir);
 	for (TUInt s = 0; s < nSymbols_; s++) //for all symbols
 	{
 		//Find the symbol boundaries and fundamental width
-		const BarcodeSymbology::Symbol *pSym = symbology_->getDataSymbol(s);
-		int symbolEdge = boundaries[s].leftEdge;
-		double xSym = (boundaries[s].rightEdge - boundaries[s].leftEdge) / (double) pSym->width;
-		int sgn = (pSym->bars.front()->isDark() ? 1 : -1);
-		int sumConv = 0;
+		double xSym = (boundaries[s].rightEdge - boundaries[s].leftEdge) / (double) dirLayout.symbolWidths[s];
+		double start = boundaries[s].leftEdge - xSym;	//patterns start one fundamental width before the symbol
+		//Sample the integral slice once at every fundamental width, which are shared by the patterns of all digits
+		for (TUInt k = 0; k < samples.size(); k++)
+			samples[k] = integralAt(data, start + k * xSym);
+		//Convolve with all the patterns this symbol may take at once
 		int symbolIndex = (isBackwards ? nSymbols_ - 1 - s : s);
-		for (TUInt d = 0; d < 10; d++)	//for all possible digits
+		TUInt nSymbolPatterns = nSymbolPatterns_[symbolIndex];
+		for (TUInt d = 0; d < nSymbolPatterns; d++)
+			conv[d] = 0;
+		for (TUInt k = 0; k < samples.size(); k++)
 		{
-			//Get the digit pattern
-			symbology_->getConvolutionPattern(d, xSym, isBackwards, pattern);
-			//Convolve at the expected digit boundaries
-			int *start = slice_.data() + ((int) (symbolEdge - pattern.front()));
-			int conv = max(dotProduct(sgn, start, pattern), 1);
-			sumConv += conv;
-			convolutions_(d, symbolIndex) = conv;
+			const double *w = weights[k];
+			for (TUInt d = 0; d < nSymbolPatterns; d++)
+				conv[d] += w[d] * samples[k];
 		}
-		for (TUInt d = 0; d < 10; d++)
+		double scale = (dirLayout.isSymbolBarDark(s, 0) ? 1 : -1) / xSym;
+		for (TUInt d = 0; d < nSymbolPatterns; d++)
+			conv[d] = max(scale * conv[d], 1.0);
+		//Normalize within each set of patterns to get the energies
+		for (TUInt set = 0; set < nSymbolPatterns; set += patternSetSize_)
 		{
-			energies_(d, symbolIndex) = -log(convolutions_(d, symbolIndex) / (double) sumConv);
+			double sumConv = 0;
+			for (TUInt d = set; d < set + patternSetSize_; d++)
+				sumConv += conv[d];
+			double logSumConv = log(sumConv);
+			for (TUInt d = set; d < set + patternSetSize_; d++)
+				scanline.energies(d, symbolIndex) = logSumConv - log(conv[d]);
 		}
 	}
 }
 
-int BarcodeDecoder::dotProduct(int sgn, const int *data, const vector<TUInt> &pattern)
+#ifdef _LIBTEST
+
+/**
+ * Extracts an integral slice as extractIntegralSlice(), interpolating and integrating in double precision
+ */
+static bool extractDoubleIntegralSlice(const TMatrixUInt8& aImg, TPointInt firstEdge, TPointInt lastEdge, TUInt width, TUInt fundamentalWidth,
+		vector<int> &slice)
 {
-	int width = pattern.back();
-	int dataMean = (data[width] - *data) / width;
-	vector<TUInt>::const_iterator j = pattern.begin();
-	int patternSum = sgn * (*j);
-	int c = sgn * ( data[*j] - *data );
-	for (j++; j != pattern.end(); j++)
+	double fundamentalWidthInImage = norm(lastEdge - firstEdge) / width;
+	TPointDouble d = lastEdge - firstEdge;
+	double theta = atan2(d.y, d.x);
+	TPointInt offset(2 * cos(theta) * fundamentalWidthInImage, 2 * sin(theta) * fundamentalWidthInImage);
+	firstEdge -= offset;
+	lastEdge += offset;
+	if ( (min(firstEdge.x, lastEdge.x) < 0) || (min(firstEdge.y, lastEdge.y) < 0)
+			|| (max(firstEdge.x, lastEdge.x) + 1 >= (int) aImg.cols) || (max(firstEdge.y, lastEdge.y) + 1 >= (int) aImg.rows) )
+		return false;
+	d = lastEdge - firstEdge;
+	theta = atan2(d.y, d.x);
+	double scaling = (double) slice.size() / norm(d);
+	TPointDouble step(cos(theta) / scaling, sin(theta) / scaling);
+	TPointDouble pt((double) firstEdge.x, (double) firstEdge.y);
+	slice.front() = aImg(firstEdge);
+	slice.back() = aImg(lastEdge);
+	double sum = slice.front();
+	for (vector<int>::iterator s = slice.begin() + 1; s != slice.end() - 1; s++)
 	{
-		sgn *= -1;
-		c += sgn * ( data[*j] - data[*(j-1)] );
-		patternSum += sgn * (*j - *(j-1));
+		pt += step;
+		TPointInt qt(floor(pt.x), floor(pt.y));
+		double dx = pt.x - qt.x, dy = pt.y - qt.y;
+		sum += (1-dy) * ((1-dx) * aImg(qt) + dx * aImg(qt.y, qt.x+1)) + dy * ((1-dx) * aImg(qt.y+1, qt.x) + dx * aImg(qt.y+1, qt.x+1));
+		*s = (int) floor(sum + 0.5);
 	}
-	return (c - patternSum * dataMean) / width;
+	slice.back() += *(slice.end() - 2);
+	return true;
 }
 
+/**
+ * Compares the fixed point integral slices with slices interpolated in double precision on noise images of several contrasts,
+ * checking that the integral slices are within 1 gray level of each other, and prints their timings
+ */
+void testIntegralSlice()
+{
+	const TUInt width = 95, nSlices = 2000;
+	const int M = 480, N = 640;
+	BarcodeDecoder::Options opts;
+	BarcodeDecoder::Slices slices(opts, width);
+	vector<int> fixedSlice((width + 4) * opts.fundamentalWidth), doubleSlice(fixedSlice.size());
+	TMatrixUInt8 img(M, N);
+	srand(1);
+	for (int contrast = 32; contrast <= 256; contrast *= 2)
+	{
+		for (int i = 0; i < M; i++)
+		{
+			for (int j = 0; j < N; j++)
+				img(i, j) = (TUInt8) (rand() % contrast);
+		}
+		double fixedTime = 0, doubleTime = 0;
+		int maxError = 0;
+		TUInt nExtracted = 0;
+		for (TUInt n = 0; n < nSlices; n++)
+		{
+			//Random barcode ends, mostly within the image once extended
+			TPointInt firstEdge(40 + rand() % (N / 2 - 80), 40 + rand() % (M - 80)), lastEdge(N / 2 + 40 + rand() % (N / 2 - 80), 40 + rand() % (M - 80));
+			if (n % 2 == 1)
+				std::swap(firstEdge, lastEdge);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			bool isFixedInImage = slices.extractIntegralSlice(img, firstEdge, lastEdge, fixedSlice);
+			std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+			bool isDoubleInImage = extractDoubleIntegralSlice(img, firstEdge, lastEdge, width, opts.fundamentalWidth, doubleSlice);
+			std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+			if (isFixedInImage != isDoubleInImage)
+			{
+				printf("Integral slice: the slices do not agree on whether they are in the image\n");
+				return;
+			}
+			if (!isFixedInImage)
+				continue;
+			fixedTime += std::chrono::duration<double>(middle - start).count();
+			doubleTime += std::chrono::duration<double>(end - middle).count();
+			nExtracted++;
+			for (TUInt k = 0; k < fixedSlice.size(); k++)
+				maxError = max(maxError, abs(fixedSlice[k] - doubleSlice[k]));
+		}
+		printf("Integral slice, contrast %d: error up to %d gray levels (%s), fixed point %.2f us, double %.2f us per slice\n",
+				contrast, maxError, (maxError <= 1 ? "pass" : "FAIL"), 1e6 * fixedTime / nExtracted, 1e6 * doubleTime / nExtracted);
+	}
+}
+#endif //LIBTEST
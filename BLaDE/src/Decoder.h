@@ -37,6 +37,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include "ski/BLaDE/Barcode.h"
 #include "ski/BLaDE/Symbology.h"
+#include "ski/viterbi.h"
+#include "WorkerPool.h"
 #include <memory>
 
 using namespace std;
@@ -69,6 +71,49 @@ public:
 		double edgeFixedLocationVar;
 		/** Coefficient to use for the variance of the relative locations of fixed edges */
 		double edgeRelativeLocationVar;
+		/**
+		 * Maximum deviation, in fundamental widths, of the distance between consecutive fixed edges from the expected distance.
+		 * Only fixed edge candidate pairs within this tolerance are considered, 0 to consider all pairs.
+		 */
+		double edgeSearchTolerance;
+		/** Whether to reject barcodes that are too small or too big relative to the image, as expected from a handheld camera */
+		bool checkFraming;
+		/** Number of consecutive frames of a tracked barcode whose digit energies are fused when a single frame fails to decode, 1 to disable */
+		TUInt nFusedFrames;
+		/** Maximum distance the center of a barcode may move between frames to be tracked, as a fraction of the barcode length */
+		double trackingTolerance;
+		/** Number of parallel scanlines across the bars whose digit energies are combined, 1 to read only along the located barcode */
+		TUInt nScanlines;
+		/** Distance between neighboring scanlines, as a fraction of the barcode length */
+		double scanlineSpacing;
+		/** Whether to combine the scanline energies by their median, which is robust to a few bad scanlines, instead of their sum */
+		bool useScanlineMedian;
+		/**
+		 * Maximum number of detected edges in a scanline beyond the edges of the symbology, as a fraction of the latter.
+		 * Scanlines with fewer edges than the symbology or more than this many extra edges are not localized,
+		 * as they most likely cross a barcode of another symbology.
+		 */
+		double maxExtraEdges;
+		/**
+		 * Maximum magnitude of the edges detected past the first and last fixed edges, relative to the weakest fixed edge.
+		 * Stronger edges are bars continuing past the fit, so that part of a longer barcode is not read as a shorter symbology.
+		 */
+		double maxQuietZoneEdgeMagnitude;
+		/**
+		 * Maximum number of times the fixed edges are fit while the fundamental width estimate changes, as the estimate
+		 * can alternate between two fits of a noisy scanline without converging.
+		 */
+		TUInt maxFitIterations;
+		/**
+		 * Maximum number of edges stronger than allowed in the quiet zones (see maxQuietZoneEdgeMagnitude) found between
+		 * the ends of a fit beyond the edges of the layout, so that a layout is not stretched over a longer barcode.
+		 */
+		TUInt maxExtraBarEdges;
+		/**
+		 * Whether to solve the Viterbi chains of a barcode together with BatchViterbi: the fixed edge fits of all the scanlines
+		 * of each layout, and the estimates of both reading directions when the direction cannot be inferred.
+		 */
+		bool useBatchViterbi;
 		/** Constructor */
 		Options():
 			edgeThresh(40),
@@ -76,7 +121,19 @@ public:
 			edgePowerCoefficient(1),
 			maxEdgeMagnitude(200),
 			edgeFixedLocationVar(10000),
-			edgeRelativeLocationVar(1)
+			edgeRelativeLocationVar(1),
+			edgeSearchTolerance(3),
+			checkFraming(true),
+			nFusedFrames(1),
+			trackingTolerance(0.1),
+			nScanlines(1),
+			scanlineSpacing(0.05),
+			useScanlineMedian(false),
+			maxExtraEdges(0.5),
+			maxQuietZoneEdgeMagnitude(0.5),
+			maxFitIterations(10),
+			maxExtraBarEdges(3),
+			useBatchViterbi(false)
 		{};
 	};
 
@@ -87,13 +144,162 @@ public:
 		DECODING_SUCCESSFUL = 1	///< Means that decoding was successful
 	};
 
+	/**
+	 * Struct containing information about a detected edge in barcode slice
+	 */
+	struct DetectedEdge
+	{
+		/** Constructor */
+		inline DetectedEdge(int p, double loc, int mag, int nPrevPos, int nPrevNeg):
+				polarity(p), location(loc), magnitude(mag),
+				nPreviousPositiveEdges(nPrevPos), nPreviousNegativeEdges(nPrevNeg) {};
+		/** Polarity, must be -1 for a light->dark edge, 1 for dark->light edge */
+		int polarity;
+		/** subpixel location of the edge in the slice */
+		double location;
+		/** magnitude of the detected edge */
+		int magnitude;
+		/** number of edges with positive polarity before this edge in the barcode slice */
+		int nPreviousPositiveEdges;
+		/** number of edges with negative polarity before this edge in the barcode slice */
+		int nPreviousNegativeEdges;
+		/** Index of this edge */
+		inline int index() const {return nPreviousPositiveEdges + nPreviousNegativeEdges; };
+	};
+
+	/**
+	 * Symbology independent front end of decoding: the integral slices along the scanlines across a barcode and the edges
+	 * detected in them. They are computed once per barcode and shared by the decoders of all symbologies, which then only
+	 * localize their own fixed edges and estimate on top of them.
+	 * Each slice spans the barcode and two fundamental widths of the widest symbology on each side.
+	 */
+	class Slices
+	{
+	public:
+		/**
+		 * Constructor
+		 * @param[in] opts decoder options, of which the edge threshold, fundamental width, framing check and scanlines are used
+		 * @param[in] width width in fundamental widths of the widest symbology to decode from the slices
+		 */
+		Slices(const Options &opts, TUInt width);
+
+		/**
+		 * Starts working on a new barcode, discarding the slices of the previous one.
+		 * Decoding is not attempted if it is deemed that the barcode is not properly seen in the image, whatever the symbology.
+		 * @param[in] bc barcode under consideration
+		 * @param[in] img image the barcode is in, which must outlive the reads of this barcode
+		 * @return true if it is determined that the barcode is visible enough to attempt decoding
+		 */
+		bool reset(const Barcode &bc, const TMatrixUInt8 &img);
+
+		/**
+		 * Extracts the slice of a scanline and detects its edges, unless already done for the current barcode.
+		 * Different scanlines may be extracted in parallel.
+		 * @param[in] k index of the scanline
+		 * @return false if the slice does not lie within the image
+		 */
+		bool extract(TUInt k);
+
+		/**
+		 * Extracts the slices and detects the edges of all the scanlines not extracted yet for the current barcode.
+		 * @param[in] workers if not NULL, pool of workers used to extract the scanlines in parallel
+		 */
+		void extractAll(WorkerPool *workers);
+
+		/** Integral slice of scanline k, once extracted */
+		inline const vector<int>& slice(TUInt k) const {return scanlines_[k].slice; };
+
+		/** Edges detected in the slice of scanline k, once extracted */
+		inline const vector<DetectedEdge>& edges(TUInt k) const {return scanlines_[k].edges; };
+
+		/** Number of scanlines */
+		inline TUInt nScanlines() const {return scanlines_.size(); };
+
+		/** Width of the widest symbology that can be decoded from the slices, in fundamental widths */
+		inline TUInt width() const {return width_; };
+
+#ifdef _LIBTEST
+		friend void testIntegralSlice();
+#endif
+
+	private:
+		/** Decoder options */
+		const Options opts_;
+
+		/** Width of the widest symbology, in fundamental widths */
+		const TUInt width_;
+
+		/** Image the current barcode is in */
+		const TMatrixUInt8 *img_;
+
+		/** First edge of the current barcode */
+		TPointInt firstEdge_;
+
+		/** Last edge of the current barcode */
+		TPointInt lastEdge_;
+
+		/** Slice and edges of a scanline */
+		struct ScanlineSlice
+		{
+			/** Integral barcode slice */
+			vector<int> slice;
+			/** Edges detected in the slice */
+			vector<DetectedEdge> edges;
+			/** Whether the scanline has been extracted for the current barcode */
+			bool isExtracted;
+			/** Whether the slice lies within the image */
+			bool isInImage;
+		};
+
+		/** Scanlines across the bars, centered on the line between the located barcode ends */
+		vector<ScanlineSlice> scanlines_;
+
+		/**
+		 * Performs tests to see whether we should attempt to decode barcode or not.
+		 * @param bc barcode under consideration
+		 * @param img image the barcode is in
+		 * @return true if it is determined that the barcode is visible enough to attempt decoding
+		 */
+		bool shouldAttemptDecoding(const Barcode &bc, const TMatrixUInt8 &img) const;
+
+		/**
+		 * Extracts the barcode image slice from input image and integrates.
+		 * The slice is stretched such that the fundamental width of the widest symbology is opts_.fundamentalWidth.
+		 * The extracted slice extends 2x beyond the detected barcode ends
+		 * @param[in] aImg grayscale image to extract slice from
+		 * @param[in] firstEdge first edge of the barcode candidate.
+		 * @param[in] lastEdge last edge of the barcode candidate.
+		 * @param[out] slice extracted integral slice
+		 * @return false if the extended slice does not lie within the image, in which case the slice is not extracted.
+		 */
+		bool extractIntegralSlice(const TMatrixUInt8& aImg, TPointInt firstEdge, TPointInt lastEdge, vector<int> &slice) const;
+
+		/**
+		 * Extracts edges from the barcode slice.
+		 * Edges are located to subpixel accuracy by fitting a parabola to the edge filter response around its extrema.
+		 * @param[in] slice integral barcode slice
+		 * @param[out] extracted edges from the barcode slice
+		 */
+		void extractEdges(const vector<int> &slice, vector<DetectedEdge> &edges) const;
+	};
+
 	/**
 	 * Constructor
 	 * @param[in] img image to use when decoding barcode
 	 * @param[in] symbology to use when decoding. The decoder then takes ownership of the symbology.
 	 * @param[in] opts options to use for decoding
+	 * @param[in] workers if not NULL, pool of workers used to process the scanlines in parallel. The pool is not owned by the decoder.
 	 */
-	BarcodeDecoder(const TMatrixUInt8& img, BarcodeSymbology* aSymbology, const Options &opts=Options());
+	BarcodeDecoder(const TMatrixUInt8& img, BarcodeSymbology* aSymbology, const Options &opts=Options(), WorkerPool *workers=NULL);
+
+	/**
+	 * Constructor for a decoder sharing the symbology of another decoder, so that barcodes can be read concurrently
+	 * by several decoders of the same symbology. The symbologies do not change once constructed.
+	 * @param[in] aDecoder decoder whose image and symbology to use
+	 * @param[in] opts options to use for decoding
+	 * @param[in] workers if not NULL, pool of workers used to process the scanlines in parallel. The pool is not owned by the decoder.
+	 */
+	BarcodeDecoder(const BarcodeDecoder &aDecoder, const Options &opts, WorkerPool *workers=NULL);
 
 	/**
 	 * Destructor
@@ -107,11 +313,44 @@ public:
 	 */
 	Result read(Barcode &bc);
 
+	/**
+	 * Reads the barcode from an image other than the one the decoder is bound to, such as another frame of a burst.
+	 * @param[in] bc barcode candidate info returned by the detection stage for img
+	 * @param[in] img image to read the barcode from
+	 * @return result of attempted decoding attempt
+	 */
+	Result read(Barcode &bc, const TMatrixUInt8 &img);
+
+	/**
+	 * Reads the barcode from slices shared with the decoders of other symbologies.
+	 * @param[in] bc barcode candidate info returned by the detection stage
+	 * @param[in,out] slices slices reset for bc, with as many scanlines as this decoder and at least as wide as the symbology.
+	 * The scanlines not extracted yet are extracted.
+	 * @return result of attempted decoding attempt
+	 */
+	Result read(Barcode &bc, Slices &slices);
+
 	/**
 	 * Name of the symbology used by this decoder
 	 */
 	inline string symbology() const {return symbology_->name(); };
 
+	/**
+	 * Width of the symbology used by this decoder in fundamental widths, which is the width of the slices it reads best
+	 */
+	inline TUInt width() const {return symbology_->width(); };
+
+	/**
+	 * Compares the edges detected on the scanlines with the signature of the symbology, so that the decoders of the
+	 * symbologies the barcode cannot be are skipped, and the others tried in order of how well they match, before any
+	 * symbol boundaries are localized.
+	 * @param[in,out] slices slices reset for the barcode to read, as in read(). The scanlines not extracted yet are extracted,
+	 * in parallel if a pool of workers is available, so that the decoders read afterwards find them extracted.
+	 * @return distance of the best matching scanline from the signature, which is 0 for a perfect match,
+	 * or -1 if no scanline has an edge count that fits the symbology.
+	 */
+	double matchSignature(Slices &slices);
+
 
 private:
 	/** Decoder options */
@@ -120,38 +359,15 @@ private:
 	/** Possible sweep directions */
 	enum SweepDirection {FORWARD = 0, BACKWARD = 1, FINISHED = 2};
 
-	/**
-	 * Struct containing information about a detected edge in barcode slice
-	 */
-	struct DetectedEdge
-	{
-		/** Constructor */
-		inline DetectedEdge(int p, int loc, int mag, int nPrevPos, int nPrevNeg):
-				polarity(p), location(loc), magnitude(mag),
-				nPreviousPositiveEdges(nPrevPos), nPreviousNegativeEdges(nPrevNeg) {};
-		/** Polarity, must be -1 for a light->dark edge, 1 for dark->light edge */
-		int polarity;
-		/** location of the edge in the slice */
-		int location;
-		/** magnitude of the detected edge */
-		int magnitude;
-		/** number of edges with positive polarity before this edge in the barcode slice */
-		int nPreviousPositiveEdges;
-		/** number of edges with negative polarity before this edge in the barcode slice */
-		int nPreviousNegativeEdges;
-		/** Index of this edge */
-		inline int index() const {return nPreviousPositiveEdges + nPreviousNegativeEdges; };
-	};
-
 	/**
 	 * Struct containing information about expected barcode symbol boundaries
 	 */
 	struct SymbolBoundary
 	{
 		/** Left edge of the symbol */
-		int leftEdge;
+		double leftEdge;
 		/** Right edge of the symbol */
-		int rightEdge;
+		double rightEdge;
 		/** Expected width of the symbol in terms of the fundamental width */
 		TUInt width;
 		/**
@@ -160,98 +376,329 @@ private:
 		 * @param[in] rEdge location of the right edge of the symbol
 		 * @param[in] w width of the symbol in terms of the fundamental width
 		 */
-		SymbolBoundary(int lEdge=0, int rEdge=0, TUInt w=0) : leftEdge(lEdge), rightEdge(rEdge), width(w) {};
+		SymbolBoundary(double lEdge=0, double rEdge=0, TUInt w=0) : leftEdge(lEdge), rightEdge(rEdge), width(w) {};
 		/**
 		 * Fundamental width of the symbol
 		 * @return returne the fundamental width of the symbol
 		 */
-		inline double fundamentalWidth() const {return ((double) rightEdge - leftEdge) / (double) width; };
+		inline double fundamentalWidth() const {return (rightEdge - leftEdge) / (double) width; };
 	};
 
 	/** Grayscale image to estimate the barcode from */
 	const TMatrixUInt8& image_;
 
-	/** Symbology used for this detector */
-	const std::unique_ptr<BarcodeSymbology> symbology_;
+	/** Symbology used for this detector, shared with the decoders constructed from this one */
+	const std::shared_ptr<BarcodeSymbology> symbology_;
+
+	/** Layout of the symbology read backwards if the symbology is not symmetric, NULL otherwise */
+	const std::shared_ptr<BarcodeSymbology> mirroredLayout_;
+
+	/**
+	 * Constructor
+	 * @param[in] img image to use when decoding barcode
+	 * @param[in] aSymbology symbology to use when decoding
+	 * @param[in] aMirroredLayout layout of the symbology read backwards if the symbology is not symmetric, NULL otherwise
+	 * @param[in] opts options to use for decoding
+	 * @param[in] workers if not NULL, pool of workers used to process the scanlines in parallel
+	 */
+	BarcodeDecoder(const TMatrixUInt8& img, const std::shared_ptr<BarcodeSymbology> &aSymbology,
+			const std::shared_ptr<BarcodeSymbology> &aMirroredLayout, const Options &opts, WorkerPool *workers);
+
+	/** Signature of the symbology */
+	const BarcodeSymbology::Signature signature_;
+
+	/** Flat layouts of the symbology in each reading direction, which are the same if the symbology is symmetric */
+	BarcodeSymbology::FlatLayout flatLayouts_[FINISHED];
 
 	/** Number of data symbols */
 	const TUInt nSymbols_;
 
-	/** Integral barcode slice to be used for symbol estimation */
-	vector<int> slice_;
+	/** Number of convolution patterns of the symbology, i.e. of rows of the energy matrices */
+	const TUInt nPatterns_;
+
+	/** Number of patterns in each set whose energies are normalized together */
+	const TUInt patternSetSize_;
+
+	/** Number of patterns each data symbol may take, whose energies are calculated */
+	vector<TUInt> nSymbolPatterns_;
+
+	/** Pool of workers to process the scanlines with, NULL to process them in the calling thread */
+	WorkerPool *workers_;
+
+	/** Slices used when reading from an image, as wide as the symbology */
+	Slices slices_;
+
+	/** Margin of the slices being read before the first edge of the barcode, in fundamental widths of the symbology */
+	double sliceMargin_;
 
 	/**
-	 * Performs tests to see whether we should attempt to decode barcode or not.
-	 * Decoding is not attempted if it is deemed that the barcode is not properly seen in the image.
-	 * @param bc barcode under consideration
-	 * @return true if it is determined that the barcode is visible enough to attempt decoding
+	 * Workspace of a single scanline across the bars, holding everything needed to localize its symbol boundaries
+	 * and calculate its digit energies, so that scanlines can be processed independently of each other.
+	 * The workspace is reused from barcode to barcode and only grows, so that decoding does not allocate once warmed up.
 	 */
-	bool shouldAttemptDecoding(const Barcode &bc);
+	struct Scanline
+	{
+		/** Integral barcode slice to be used for symbol estimation, owned by the slices being read */
+		const vector<int> *slice;
+		/** Edges detected in the slice, owned by the slices being read */
+		const vector<DetectedEdge> *detectedEdges;
+		/** fixedEdgeCandidates[i] has pointers to detected edges that may be fixed edge i */
+		vector<vector<const DetectedEdge*> > fixedEdgeCandidates;
+		/** Fixed edge priors for the Viterbi */
+		vector<vector<TEnergy> > priors;
+		/** Fixed edge conditionals for the Viterbi, views into conditionalBuffers */
+		vector<TMatEnergy> conditionals;
+		/** Storage for the fixed edge conditionals, large enough for the most candidates seen so far */
+		vector<TMatEnergy> conditionalBuffers;
+		/** bands[n][j] is the range of candidates for fixed edge n that may precede candidate j for fixed edge n+1 */
+		vector<vector<pair<int, int> > > bands;
+		/** Viterbi for the fixed edges, created on first use as it refers to the members above */
+		std::unique_ptr<Viterbi<TEnergy> > viterbi;
+		/** Localized symbol boundaries */
+		vector<SymbolBoundary> boundaries;
+		/** Whether the symbol boundaries of this scanline were localized */
+		bool isLocalized;
+		/** Energy of the best fit of the fixed edges, once localized */
+		TEnergy fitEnergy;
+		/** Fundamental width estimate of the fit of the fixed edges */
+		double fitWidth;
+		/** Matrix to store pattern energies, energies(pattern, symbol)*/
+		TMatEnergy energies;
+		/** Integral slice sampled at the fundamental widths of the current symbol */
+		vector<double> samples;
+		/** Convolutions of the current symbol with all patterns */
+		vector<double> convolutions;
+		/**
+		 * Constructor
+		 * @param[in] nFixedEdges number of fixed edges in the symbology
+		 * @param[in] nSymbols number of data symbols in the symbology
+		 * @param[in] nPatterns number of convolution patterns of the symbology
+		 */
+		Scanline(TUInt nFixedEdges, TUInt nSymbols, TUInt nPatterns);
+	};
+
+	/** Scanlines across the bars, centered on the line between the located barcode ends */
+	vector<Scanline> scanlines_;
+
+	/** The same scanlines localized with the mirrored layout, empty if the symbology is symmetric */
+	vector<Scanline> mirroredScanlines_;
+
+	/**
+	 * Layout of the symbology in a reading direction
+	 * @param[in] dir reading direction
+	 * @return the flat mirrored layout when reading an asymmetric symbology backwards, that of the symbology otherwise
+	 */
+	inline const BarcodeSymbology::FlatLayout& layout(int dir) const {return flatLayouts_[dir]; };
 
 	/**
-	 * Extracts the barcode image slice from input image and integrates.
-	 * The slice is stretched such that the fundamental width is x.
-	 * The extracted slice extends 2x beyond the detected barcode ends
-	 * @param[in] aImg grayscale image to extract slice from
-	 * @param[in] firstEdge first edge of the barcode candidate.
-	 * @param[in] lastEdge last edge of the barcode candidate.
+	 * Scanlines localized for a reading direction
+	 * @param[in] dir reading direction
+	 * @return the mirrored scanlines when reading an asymmetric symbology backwards, scanlines_ otherwise
 	 */
-	void extractIntegralSlice(const TMatrixUInt8& aImg, TPointInt firstEdge, TPointInt lastEdge);
+	inline vector<Scanline>& scanlines(int dir) {return ( (dir == BACKWARD) && mirroredLayout_ ? mirroredScanlines_ : scanlines_ ); };
 
 	/**
-	 * Extracts edges from the barcode slice
-	 * @param[out] extracted edges from the barcode slice
+	 * Extracts a scanline of a barcode unless already extracted, and localizes its symbol boundaries
+	 * @param[in] k index of the scanline
+	 * @param[in,out] slices slices of the barcode under consideration
 	 */
-	void extractEdges(vector<DetectedEdge> &edges);
+	void localizeScanline(TUInt k, Slices &slices);
 
 	/**
-	 * Localizes the fixed edges to get accurate symbol boundaries and fundamental width estimates.
-	 * @param[out] symbolBoundaries localized symbol boundaries
+	 * Distance of the bars at the ends of a scanline from the guard patterns of the symbology, in either direction,
+	 * plus the relative difference of the width of the scanline in the fundamental widths given by the guards from the
+	 * width of the symbology.
+	 * @param[in] edges edges detected on the scanline
+	 * @return mean difference of the bar widths from the guard patterns in fundamental widths plus the width difference,
+	 * 0 if the symbology has no guard patterns
+	 */
+	double guardDistance(const vector<DetectedEdge> &edges);
+
+	/**
+	 * Extracts the scanlines of a barcode and localizes their symbol boundaries, in parallel if a pool of workers is available.
+	 * @param[in,out] slices slices of the barcode under consideration
+	 * @param[out] nLocalized number of scanlines whose symbol boundaries were localized for each reading direction
+	 * @return number of scanlines whose symbol boundaries were localized in the direction with the most
+	 */
+	TUInt localizeScanlines(Slices &slices, TUInt (&nLocalized)[FINISHED]);
+
+	/**
+	 * Localizes the fixed edges of a scanline to get accurate symbol boundaries and fundamental width estimates.
+	 * @param[in] aLayout layout of the symbology to fit to the edges of the scanline
+	 * @param[in,out] scanline scanline with an extracted slice and edges, whose symbol boundaries are localized
 	 * @return true if an estimate is found, false if not enough edges were determined.
 	 */
-	bool localizeFixedEdges(vector<SymbolBoundary> &symbolBoundaries);
+	bool localizeFixedEdges(const BarcodeSymbology::FlatLayout &aLayout, Scanline &scanline) const;
+
+	/**
+	 * Finds the fixed edge candidates of a scanline and sizes its priors and conditionals, before the fixed edges are fit.
+	 * @param[in] aLayout layout of the symbology to fit to the edges of the scanline
+	 * @param[in,out] scanline scanline with an extracted slice and edges, whose fitWidth is set to the initial fundamental width estimate
+	 * @return true if all fixed edges have candidates
+	 */
+	bool prepareFixedEdges(const BarcodeSymbology::FlatLayout &aLayout, Scanline &scanline) const;
+
+	/**
+	 * Checks the converged fit of the fixed edges of a scanline against the other detected edges, and returns its symbol boundaries.
+	 * @param[in] aLayout layout of the symbology fit to the edges of the scanline
+	 * @param[in,out] scanline scanline whose fixed edges were fit, whose boundaries are set if the fit passes
+	 * @param[in] bestFitEdges bestFitEdges[n] is the index of the candidate fit to fixed edge n
+	 * @param[in] x fundamental width estimate of the fit
+	 * @return true if the fit passes the checks
+	 */
+	bool checkFixedEdges(const BarcodeSymbology::FlatLayout &aLayout, Scanline &scanline, const vector<int> &bestFitEdges, double x) const;
+
+	/**
+	 * Fits the fixed edges of all the prepared scanlines of a reading direction together in fixedEdgeBatch_.
+	 * The chains are padded to the most candidates of any scanline for each fixed edge, and the scanlines leave the batch
+	 * as their fundamental width estimates converge, as localizeFixedEdges() does for a single scanline.
+	 * @param[in] dir reading direction, whose scanlines are localized if their fits converge and pass the checks
+	 */
+	void fitFixedEdges(int dir);
 
 	/**
 	 * Finds which detected edges can be candidates for the fixed edges of the barcode
+	 * @param[in] aLayout layout of the symbology
 	 * @param[in] detectedEdges detected edges of the barcode stripe
 	 * @param[out] fixedEdgeCandidates fixedEdgeCandidates[i] is a vector of references to the
 	 * detected edges that may be fixed edge [i] in the symbology.
 	 * @return true if all fixed edges can be matched, false if the detected edges cannot be matched to the symbology.
 	 */
-	bool getFixedEdgeCandidates(const vector<DetectedEdge> &detectedEdges,
-			vector<vector<const DetectedEdge*> > &fixedEdgeCandidates);
+	bool getFixedEdgeCandidates(const BarcodeSymbology::FlatLayout &aLayout, const vector<DetectedEdge> &detectedEdges,
+			vector<vector<const DetectedEdge*> > &fixedEdgeCandidates) const;
 
 	/**
 	 * Calculates the fixed edge priors - energies due to the difference of fixed edge candidates from expected absolute locations.
+	 * @param[in] aLayout layout of the symbology
 	 * @param[in] fixedEdgeCandidates list of fixed edge candidates as given by getFixedEdgeCandidates()
 	 * @param[in] x estimate of the fundamental width to use
 	 * @param[out] priors vector of priors for each fixed edge in the symbology.
-	 * @param[out] conditionals vector of priors for each fixed edge in the symbology.
+	 * @param[out] conditionals vector of conditionals between consecutive fixed edges, already sized for the candidates.
+	 * If the search is banded, only the conditionals within the bands are calculated.
+	 * @param[out] bands bands of the possible transitions between candidates if opts_.edgeSearchTolerance > 0, untouched otherwise.
+	 */
+	void calculateFixedEdgeEnergies(const BarcodeSymbology::FlatLayout &aLayout, const vector<vector<const DetectedEdge*> > &fixedEdgeCandidates,
+			double x, vector<vector<TEnergy> > &priors, vector<TMatEnergy> &conditionals, vector<vector<pair<int, int> > > &bands) const;
+
+	/**
+	 * Infers the reading direction from the parities of the numbers of dark modules in the data symbols of the localized
+	 * scanlines, as measured from the detected edges, so that only one direction needs to be estimated.
+	 * The direction of an asymmetric symbology is instead inferred from which of its layouts fits the edges better.
+	 * @return FORWARD or BACKWARD if the parities clearly favor that direction, FINISHED if the direction is unclear
+	 * or the symbology does not define the parities.
 	 */
-	void calculateFixedEdgeEnergies(const vector<vector<const DetectedEdge*> > &fixedEdgeCandidates,
-			double x, vector<vector<TEnergy> > &priors, vector<TMatEnergy> &conditionals);
+	int inferDirection() const;
 
 	/**
-	 * Calculate the digit energies
+	 * Calculate the digit energies of a scanline
 	 * @param[in] dir direction to convolve (in case of backwards barcode)
-	 * @param[in] boundaries detected boundaries for the symbols
+	 * @param[in,out] scanline localized scanline, whose energies are calculated
+	 */
+	void getDigitEnergies(int dir, Scanline &scanline) const;
+
+	/**
+	 * Calculates the digit energies of the localized scanlines and combines them into energies_[dir]
+	 * @param[in] dir direction to convolve (in case of backwards barcode)
+	 */
+	void getDigitEnergies(int dir);
+
+	/**
+	 * Precomputes convolutionWeights_ from the convolution patterns of the symbology
+	 * @throw logic_error if the pattern edges do not fall on whole fundamental widths
+	 */
+	void initConvolutionWeights();
+
+	/**
+	 * Samples an integral slice at a fractional location.
+	 * The integral of the piecewise constant slice is piecewise linear, so linear interpolation is exact.
+	 * @param[in] data integral slice
+	 * @param[in] location location to sample at, must be non-negative
+	 * @return the integral up to location
+	 */
+	static inline double integralAt(const int *data, double location)
+	{
+		int i = (int) location;
+		return data[i] + (location - i) * (data[i + 1] - data[i]);
+	};
+
+	/**
+	 * Convolution weights of all patterns in each direction, with the mean removed.
+	 * The pattern edges fall on whole fundamental widths, so the convolution of pattern d is
+	 * the sum over k of convolutionWeights_[dir](k, d) times the integral slice k fundamental widths into the pattern.
+	 * The weights do not depend on the fundamental width, which only sets where the slice is sampled, so this bank of
+	 * patterns serves every symbol at its own fundamental width without quantizing it, and a row of weights holds the
+	 * weights of all patterns for a sample.
 	 */
-	void getDigitEnergies(int dir, const vector<SymbolBoundary> &boundaries);
+	vector<TMatrixDouble> convolutionWeights_;
+
+	/** Matrices to store pattern energies combined over the scanlines in each direction, energies_[dir](pattern, symbol)*/
+	vector<TMatEnergy> energies_;
+
+	/** Batch of the fixed edge fits of the scanlines, when solving them together */
+	BatchViterbi<TEnergy> fixedEdgeBatch_;
+
+	/** Number of states at each fixed edge of fixedEdgeBatch_ */
+	vector<int> batchStates_;
+
+	/** Scanlines whose fixed edges are still being fit in fixedEdgeBatch_ */
+	vector<Scanline*> fittingScanlines_;
+
+	/** Batch of the estimates of both directions, of two paths for the margin of the best estimate */
+	BatchViterbi<TEnergy> estimateBatch_;
+
+	/** Energies of the barcodes estimated in estimateBatch_ */
+	vector<const TMatEnergy*> batchEnergies_;
+
+	/** Estimates of the barcodes estimated in estimateBatch_ */
+	vector<string> batchEstimates_;
+
+	/** Scratch space for the median of the scanline energies */
+	vector<TEnergy> scanlineEnergies_;
+
+	/** Scratch space for the magnitudes of the edges of a scanline when matching the guard patterns */
+	vector<int> edgeMagnitudes_;
+
+	/** Scratch space for the widths of the bars at the ends of a scanline when matching the guard patterns */
+	vector<double> guardBars_;
 
 	/**
-	 * Used by convolve(), this function calculates the dot product at a specific place
-	 * @param[in] sgn sign of the initial bit - will flip at every pattern edge
-	 * @param[in] beginning of the data to calculate the dot-product for
-	 * @param[in] pattern pattern to convolve with
-	 * @return result of the convolution
+	 * Ring buffer of the digit energies of the last few frames of the tracked barcode, in both directions.
+	 * fusedFrames_[n][dir] holds the energies of frame n read in direction dir relative to the tracked ends.
 	 */
-	static int dotProduct(int sgn, const int *data, const vector<TUInt> &pattern);
+	vector<vector<TMatEnergy> > fusedFrames_;
+
+	/** Number of frames in fusedFrames_ */
+	TUInt nFusedFrames_;
+
+	/** Index of the newest frame in fusedFrames_ */
+	TUInt newestFusedFrame_;
+
+	/** Bit mask of the directions whose energies are stored for each frame in fusedFrames_, as only one may be read */
+	vector<int> fusedFrameDirections_;
+
+	/** Sum of the energies of the fused frames */
+	TMatEnergy fusedEnergies_;
+
+	/** First edge of the tracked barcode in the last frame */
+	TPointInt trackedFirstEdge_;
 
-	/** Matrix to store digit energies, energies_(digit, symbol)*/
-	TMatEnergy energies_;
+	/** Last edge of the tracked barcode in the last frame */
+	TPointInt trackedLastEdge_;
 
-	/** Matrix to store digit convolution values, convolutions_(digit, symbol)*/
-	TMatrixInt convolutions_;
+	/**
+	 * Matches a barcode to the one tracked in the previous frames by its center and orientation,
+	 * and starts tracking anew if it does not match.
+	 * @param[in] bc barcode in the current frame
+	 * @return true if the ends of the barcode are swapped with respect to the tracked barcode
+	 */
+	bool trackBarcode(const Barcode &bc);
+
+	/**
+	 * Estimates the barcode from the sum of the digit energies of the tracked frames
+	 * @param[in] dir direction relative to the tracked ends
+	 * @return estimated barcode, empty if the estimate is not reliable or fewer than two frames were read in this direction
+	 */
+	string estimateFused(int dir);
 };
 
 
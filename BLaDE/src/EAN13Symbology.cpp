@@ -0,0 +1,179 @@
+/*
+Copyright (c) 2012, The Smith-Kettlewell Eye Research Institute
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the The Smith-Kettlewell Eye Research Institute nor
+      the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE SMITH-KETTLEWELL EYE RESEARCH INSTITUTE BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file EAN13Symbology.cpp
+ * EAN-13 symbology, read with the UPC-A layout and digit patterns.
+ * @author Ender Tekin
+ */
+
+#include "EAN13Symbology.h"
+#include "ski/log.h"
+#include "ski/math.h"
+#include <algorithm>
+#include <stdexcept>
+
+const TUInt Ean13Symbology::isEvenParity_[10][N_HALF_DIGITS_] =
+{
+		{0, 0, 0, 0, 0, 0},
+		{0, 0, 1, 0, 1, 1},
+		{0, 0, 1, 1, 0, 1},
+		{0, 0, 1, 1, 1, 0},
+		{0, 1, 0, 0, 1, 1},
+		{0, 1, 1, 0, 0, 1},
+		{0, 1, 1, 1, 0, 0},
+		{0, 1, 0, 1, 0, 1},
+		{0, 1, 0, 1, 1, 0},
+		{0, 1, 1, 0, 1, 0}
+};
+
+const char* const Ean13Symbology::UPCA_EAN13_NAME = "UPC-A/EAN-13";
+
+Ean13Symbology::Ean13Symbology(const Options &opts/*=Options()*/) :
+		UpcaSymbology(opts.isUpcaReported ? UPCA_EAN13_NAME : "EAN-13", opts),
+		isUpcaReported_(opts.isUpcaReported)
+{
+	addUpcaSymbols(N_DIGITS_);
+	LOGD("EAN13 Symbology created\n");
+}
+
+Ean13Symbology::~Ean13Symbology() {}
+
+TUInt Ean13Symbology::nPatterns() const
+{
+	return 20;
+}
+
+TUInt Ean13Symbology::patternSetSize() const
+{
+	return 10;
+}
+
+TUInt Ean13Symbology::nSymbolPatterns(TUInt i) const
+{
+	return (i < N_HALF_DIGITS_ ? 20 : 10);
+}
+
+int Ean13Symbology::darkModuleParity(TUInt i) const
+{
+	return (i < N_HALF_DIGITS_ ? -1 : 0);
+}
+
+string Ean13Symbology::estimate(const TMatEnergy &energies) const
+{
+	//-----------
+	//Joint estimation of the first digit with the check digit
+	//-----------
+	if ( (nDataSymbols() != N_DIGITS_) || (energies.rows != nPatterns()) )
+		throw logic_error("Ean13Symbology: unexpected number of data symbols or patterns");
+	//The right half does not depend on the first digit, so its paths are found once
+	static const TUInt rightRows[N_HALF_DIGITS_] = {};
+	TEnergy rightEnergies[10][2];
+	TUInt8 rightBackPointers[N_HALF_DIGITS_][10];
+	solveChecksumPaths(energies, N_HALF_DIGITS_, N_HALF_DIGITS_, rightRows, 0, rightEnergies, rightBackPointers);
+	TEnergy minRightEnergy = rightEnergies[0][0];
+	for (TUInt state = 1; state < 10; state++)
+		minRightEnergy = min(minRightEnergy, rightEnergies[state][0]);
+	//Lower bound of the energies of the codes with each first digit, from the most likely digit of each parity in the left half
+	TEnergy minDigitEnergies[2][N_HALF_DIGITS_];
+	for (TUInt t = 0; t < N_HALF_DIGITS_; t++)
+	{
+		for (TUInt parity = 0; parity < 2; parity++)
+		{
+			minDigitEnergies[parity][t] = energies(10 * parity, t);
+			for (TUInt digit = 1; digit < 10; digit++)
+				minDigitEnergies[parity][t] = min(minDigitEnergies[parity][t], energies(10 * parity + digit, t));
+		}
+	}
+	std::pair<TEnergy, TUInt> bounds[10];
+	for (TUInt firstDigit = 0; firstDigit < 10; firstDigit++)
+	{
+		TEnergy bound = minRightEnergy;
+		for (TUInt t = 0; t < N_HALF_DIGITS_; t++)
+			bound += minDigitEnergies[isEvenParity_[firstDigit][t]][t];
+		bounds[firstDigit] = std::pair<TEnergy, TUInt>(bound, firstDigit);
+	}
+	sort(bounds, bounds + 10);
+	//Solve the left half for each first digit in increasing order of their bounds, until no first digit can beat the second best code.
+	//The wrong parities are unlikely, so usually only the first digit of the best code is solved.
+	TEnergy bestEnergy = ski::MaxValue<TEnergy>(), secondBestEnergy = ski::MaxValue<TEnergy>();
+	TUInt bestFirstDigit = 0, bestLeftState = 0, bestBuffer = 0;
+	TUInt8 leftBackPointers[2][N_HALF_DIGITS_][10];	//the best code so far is kept in one buffer, while the next first digit is solved in the other
+	for (TUInt i = 0; (i < 10) && (bounds[i].first < secondBestEnergy); i++)
+	{
+		TUInt firstDigit = bounds[i].second, buffer = 1 - bestBuffer, rows[N_HALF_DIGITS_];
+		for (TUInt t = 0; t < N_HALF_DIGITS_; t++)
+			rows[t] = 10 * isEvenParity_[firstDigit][t];
+		//The first digit is weighted by 1 in the checksum
+		TEnergy leftEnergies[10][2];
+		solveChecksumPaths(energies, 0, N_HALF_DIGITS_, rows, firstDigit, leftEnergies, leftBackPointers[buffer]);
+		for (TUInt state = 0; state < 10; state++)
+		{
+			//The right half must complete the checksum to a multiple of 10
+			const TEnergy *left = leftEnergies[state], *right = rightEnergies[(10 - state) % 10];
+			TEnergy energy = left[0] + right[0], runnerUp = min(left[1] + right[0], left[0] + right[1]);
+			if (energy < bestEnergy)
+			{
+				secondBestEnergy = min(bestEnergy, runnerUp);
+				bestEnergy = energy;
+				bestFirstDigit = firstDigit;
+				bestLeftState = state;
+				bestBuffer = buffer;
+			}
+			else
+				secondBestEnergy = min(secondBestEnergy, energy);
+		}
+	}
+	TUInt digits[N_DIGITS_], patterns[N_DIGITS_];
+	backtrackChecksum(N_HALF_DIGITS_, N_HALF_DIGITS_, rightBackPointers, (10 - bestLeftState) % 10, digits + N_HALF_DIGITS_);
+	backtrackChecksum(0, N_HALF_DIGITS_, leftBackPointers[bestBuffer], bestLeftState, digits);
+	string eanStr(1, (char) ('0' + bestFirstDigit));
+	for (TUInt symbol = 0; symbol < N_DIGITS_; symbol++)
+	{
+		patterns[symbol] = digits[symbol] + (symbol < N_HALF_DIGITS_ ? 10 * isEvenParity_[bestFirstDigit][symbol] : 0);
+		eanStr += (char) ('0' + digits[symbol]);
+	}
+	if (isUpcaReported_ && (bestFirstDigit == 0))
+		eanStr.erase(0, 1);
+
+	//-----------
+	//Checks
+	//-----------
+	return (isVerified(energies, patterns, bestEnergy, secondBestEnergy, eanStr) ? eanStr : string());
+}
+
+void Ean13Symbology::estimateBatch(const vector<const TMatEnergy*> &energies, BatchViterbi<TEnergy> &batch, vector<string> &estimates) const
+{
+	//The joint estimation is not a single checksum chain, so the barcodes are estimated one at a time
+	BarcodeSymbology::estimateBatch(energies, batch, estimates);
+}
+
+const char* Ean13Symbology::estimateName(const string &anEstimate) const
+{
+	return (isUpcaReported_ && (anEstimate.size() == N_DIGITS_) ? "UPC-A" : "EAN-13");
+}
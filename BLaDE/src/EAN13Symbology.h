@@ -0,0 +1,134 @@
+/*
+Copyright (c) 2012, The Smith-Kettlewell Eye Research Institute
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the The Smith-Kettlewell Eye Research Institute nor
+      the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE SMITH-KETTLEWELL EYE RESEARCH INSTITUTE BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file EAN13Symbology.h
+ * EAN-13 symbology, read with the UPC-A layout and digit patterns.
+ * @author Ender Tekin
+ */
+
+#ifndef EAN13SYMBOLOGY_H_
+#define EAN13SYMBOLOGY_H_
+
+#include "UPCASymbology.h"
+
+/**
+ * EAN-13 symbology, which has the UPC-A layout and encodes its first digit in the parities of the left half digits.
+ * Left half digits are encoded either with the UPC-A digit patterns of odd parity, or with their reverses of even parity.
+ * UPC-A codes are the EAN-13 codes whose first digit is 0, so this symbology also reads them.
+ */
+class Ean13Symbology: public UpcaSymbology
+{
+public:
+	/**
+	 * Decoding options
+	 */
+	struct Options: public UpcaSymbology::Options
+	{
+		/** Whether the codes whose first digit is 0 are reported as 12 digit UPC-A codes */
+		bool isUpcaReported;
+		/** Constructor */
+		Options():
+			UpcaSymbology::Options(),
+			isUpcaReported(false)
+		{};
+	};
+
+	/**
+	 * Constructor
+	 */
+	Ean13Symbology(const Options &opts = Options());
+
+	/**
+	 * Destructor
+	 */
+	virtual ~Ean13Symbology();
+
+	/**
+	 * Number of convolution patterns: the ten odd parity digit patterns, followed by the ten even parity digit patterns
+	 */
+	virtual TUInt nPatterns() const;
+
+	/**
+	 * Number of patterns in each set whose energies are normalized together, the odd and even parity digits being separate sets
+	 * so that the energies of the odd parity digits are those of UPC-A.
+	 */
+	virtual TUInt patternSetSize() const;
+
+	/**
+	 * Number of patterns a data symbol may take
+	 * @param[in] i index of the data symbol
+	 * @return 20 for the left half, 10 for the right half
+	 */
+	virtual TUInt nSymbolPatterns(TUInt i) const;
+
+	/**
+	 * Parity of the number of dark modules in a data symbol.
+	 * @param[in] i index of the data symbol
+	 * @return -1 for the left half, whose parity depends on the first digit, 0 for the right half
+	 */
+	virtual int darkModuleParity(TUInt i) const;
+
+	/**
+	 * Estimates the barcode from the matrix of pattern energies for each symbol
+	 * @param[in] energies matrix of pattern energies per symbol
+	 * @return a string that is the barcode estimate, empty string if estimate fails verification
+	 */
+	string estimate(const TMatEnergy &energies) const;
+
+	/**
+	 * Estimates several barcodes, each on its own with estimate()
+	 * @param[in] energies energies[b] is the matrix of pattern energies per symbol of barcode b
+	 * @param[in,out] batch unused
+	 * @param[out] estimates estimates[b] is the estimate of barcode b, empty string if it fails verification
+	 */
+	virtual void estimateBatch(const vector<const TMatEnergy*> &energies, BatchViterbi<TEnergy> &batch, vector<string> &estimates) const;
+
+	/**
+	 * Name of the symbology of an estimate
+	 * @param[in] anEstimate estimate returned by estimate()
+	 * @return UPC-A for 12 digit estimates, EAN-13 otherwise
+	 */
+	virtual const char* estimateName(const string &anEstimate) const;
+
+	/** Name of the symbology when it also reports UPC-A codes */
+	static const char* const UPCA_EAN13_NAME;
+
+protected:
+	/** Whether the codes whose first digit is 0 are reported as UPC-A codes */
+	bool isUpcaReported_;
+
+	/** Number of digits in each half */
+	static const TUInt N_HALF_DIGITS_ = N_DIGITS_ / 2;
+
+	/** isEvenParity_[first digit][i] is 1 if the i'th left half digit is encoded with even parity */
+	static const TUInt isEvenParity_[10][N_HALF_DIGITS_];
+};
+
+
+#endif /* EAN13SYMBOLOGY_H_ */
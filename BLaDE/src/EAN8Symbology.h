@@ -0,0 +1,62 @@
+/*
+Copyright (c) 2012, The Smith-Kettlewell Eye Research Institute
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the The Smith-Kettlewell Eye Research Institute nor
+      the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE SMITH-KETTLEWELL EYE RESEARCH INSTITUTE BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file EAN8Symbology.h
+ * EAN-8 symbology, read with the UPC-A layout shortened to eight digits.
+ * @author Ender Tekin
+ */
+
+#ifndef EAN8SYMBOLOGY_H_
+#define EAN8SYMBOLOGY_H_
+
+#include "UPCASymbology.h"
+
+/**
+ * EAN-8 symbology, which has the guard bands, digit patterns and check digit weights of UPC-A, with four digits in each half.
+ */
+class Ean8Symbology: public UpcaSymbology
+{
+public:
+	/**
+	 * Constructor
+	 */
+	Ean8Symbology(const Options &opts = Options());
+
+	/**
+	 * Destructor
+	 */
+	virtual ~Ean8Symbology();
+
+protected:
+	/** Number of data symbols, i.e. digits including the check digit */
+	static const TUInt N_EAN8_DIGITS_ = 8;
+};
+
+
+#endif /* EAN8SYMBOLOGY_H_ */
@@ -39,7 +39,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 BarcodeLocator::BarcodeLocator(const TMatrixUInt8 &img, const Options &opts/* Options()*/):
 	opts_(opts),
 	image_(img, opts),
-	mapPixelToCell_(image_.size())
+	mapPixelToCell_(image_.size()),
+	sharpness_(0),
+	nStreamedRows_(0),
+	nStreamedCellRows_(0)
 {
 	prepareCells();
 	prepareTrigLookups();
@@ -82,12 +85,39 @@ void BarcodeLocator::locate(BarcodeList& barcodes)
 	}
 }
 
+void BarcodeLocator::pushRows(TUInt nRows)
+{
+	if (nRows <= nStreamedRows_)
+		return;	//no new rows
+	if (nStreamedRows_ == 0)	//new frame
+	{
+		resetCellHistograms();
+		image_.resetRows();
+		nStreamedCellRows_ = 0;
+	}
+	nStreamedRows_ = nRows;
+	//Calculate the gradients for the new rows, and add the votes of each completed row of cells
+	TUInt nGradientRows = image_.updateRows(nRows);
+	for ( ; nStreamedCellRows_ < cells_.size(); nStreamedCellRows_++)
+	{
+		const TRectInt &box = cells_[nStreamedCellRows_].front().box;
+		if ((TUInt) (box.y + box.height) > nGradientRows)
+			break;	//cell row not complete yet
+		accumulateCellHistograms(box.y, box.y + box.height);
+	}
+}
+
 void BarcodeLocator::getOrientationCandidates(vector<Vote> &orientationModes)
 {
-	//Calculate gradients
-	image_.update();
-	//Calculate histograms for each cell
-	calculateCellHistograms();
+	if (nStreamedCellRows_ < cells_.size())	//unless already done while the rows were being pushed
+	{
+		//Calculate gradients
+		image_.update();
+		//Calculate histograms for each cell
+		calculateCellHistograms();
+	}
+	//Next frame starts streaming anew
+	nStreamedRows_ = nStreamedCellRows_ = 0;
 	//Calculate votes for the orientation histogram
 	calculateOrientationHistogram();
 	//Find modes of the orientation histogram
@@ -96,17 +126,27 @@ void BarcodeLocator::getOrientationCandidates(vector<Vote> &orientationModes)
 
 void BarcodeLocator::calculateCellHistograms()
 {
-	static const TUInt M = image_.size().height, N = image_.size().width;
+	resetCellHistograms();
+	accumulateCellHistograms(0, image_.size().height);
+}
+
+void BarcodeLocator::resetCellHistograms()
+{
 	//initialize histograms and voters
 	for (vector<vector<Cell> >::iterator pCellRow = cells_.begin(); pCellRow != cells_.end(); pCellRow++)
 	{
 		for (vector<Cell>::iterator pCell = pCellRow->begin(); pCell != pCellRow->end(); pCell++)
 			pCell->reset();
 	}
+}
+
+void BarcodeLocator::accumulateCellHistograms(TUInt rowBegin, TUInt rowEnd)
+{
+	const TUInt N = image_.size().width;
 	//TODO: use matrix class with iterator
 	//Scan points and populate the histograms of corresponding cell
-	static const TMatrixUInt8& magnitude = image_.magnitudes(), orientation = image_.orientations();
-	for (TUInt i = 0; i < M; i++)
+	const TMatrixUInt8 &magnitude = image_.magnitudes(), &orientation = image_.orientations();
+	for (TUInt i = rowBegin; i < rowEnd; i++)
 	{
 		const TUInt8 *magRowPtr = magnitude[i], *magRowEnd = magnitude[i] + N, *angRowPtr = orientation[i];
 		for (Cell **mapRowPtr = mapPixelToCell_[i]; magRowPtr < magRowEnd; magRowPtr++, angRowPtr++, mapRowPtr++)
@@ -122,6 +162,9 @@ void BarcodeLocator::calculateOrientationHistogram()
 	//Calculate votes for overall histogram
 	orientationHistogram_.assign(2 * opts_.nOrientations, 0); //initialize to 0.
 	vector<TUInt>::iterator hCell, h;
+	//The mean magnitude of the voters is used as a measure of the sharpness of the frame
+	double magnitudeSum = 0;
+	TUInt nVoters = 0;
 	for (vector<vector<Cell> >::iterator pCellRow = cells_.begin(); pCellRow != cells_.end(); pCellRow++)
 	{
 		for (vector<Cell>::iterator pCell = pCellRow->begin(); pCell != pCellRow->end(); pCell++)
@@ -133,9 +176,13 @@ void BarcodeLocator::calculateOrientationHistogram()
 				//add the cell histogram (unweighted) to the global histogram.
 				for (TUInt o = 0; o < 2 * opts_.nOrientations; o++)
 					orientationHistogram_[o] += pCell->orientationHistogram[o];
+				for (TUInt o = 0; o < opts_.nOrientations; o++)
+					magnitudeSum += pCell->weightedOrientationHistogram[o];
+				nVoters += pCell->nVoters();
 			}
 		}
 	}
+	sharpness_ = (nVoters > 0 ? magnitudeSum / nVoters : 0);
 }
 
 void BarcodeLocator::findOrientationHistogramModes(vector<Vote> &orientationModes)
@@ -211,9 +258,8 @@ void BarcodeLocator::getBarcodeCandidates(const vector<Vote> &modes)
 		vector<TPointInt> candidates; //vector of candidate centers for barcode at this orientation
 		getCandidateCellClusters(m->loc, candidates);
 		//Now scan lines through the barcode area and see if this does look like a barcode
-		TUInt8 orientation = floor(m->loc);
-		if (m->loc >= (orientation + .5))
-			orientation = (orientation + 1) % opts_.nOrientations;
+		//Round to nearest orientation - the modulo also guards against a mode that wrapped to exactly nOrientations
+		TUInt8 orientation = ((int) floor(m->loc + .5)) % opts_.nOrientations;
 		for (vector<TPointInt>::const_iterator p = candidates.begin(); p != candidates.end(); p++)
 		{
 			BarcodeCandidate aBC(orientation);	//barcode candidate - will be saved if passes the scan
@@ -227,7 +273,7 @@ void BarcodeLocator::getCandidateCellClusters(double theta, vector<TPointInt> &c
 {
 	//use the floor and ceiling of the mode to find barcode candidate limits.
 	TUInt8 thetaQuantFloor = (TUInt8) floor(theta), thetaQuantCeil = ( (thetaQuantFloor + 1) % opts_.nOrientations );
-	static GaussianKernelPt kernel(5 * opts_.cellSize);
+	const GaussianKernelPt kernel(5 * opts_.cellSize);
 	vector<VoteP> votes, shiftedVotes, clusterCenters;
 	for (vector<vector<Cell> >::iterator pRow = cells_.begin(); pRow != cells_.end(); pRow++)
 	{
@@ -251,28 +297,42 @@ bool BarcodeLocator::scanSegment(BarcodeCandidate &aBC, const TPointInt &pt)
 	bool *isAcceptable = isAcceptable_[aBC.orientation];
 	double theta = (ski::PI / opts_.nOrientations)* aBC.orientation;
 	TPointDouble step(cos(theta), sin(theta));
-	static const TRectInt imageRect(TPointInt(0,0), image_.size());
+	const TRectInt imageRect(TPointInt(0,0), image_.size());
 	if (!imageRect.contains(pt))
 		LOGE("Why is this being called with a cluster center outside the image rectangle?\n");
-	const TMatrixUInt8 magnitude = image_.magnitudes(), orientation = image_.orientations();
+	const TMatrixUInt8 magnitude = image_.magnitudes(), orientation = image_.orientations(), intensity = image_.get();
 	aBC.nEdges = 0;
+	//Statistics for the sharpness and contrast of the segment
+	TUInt magnitudeSum = 0, nEdgePixels = 0;
+	TUInt8 minIntensity = 255, maxIntensity = 0;
 	for (int dir = 0; dir < 2; dir++) //starting from a TPointInt in the middle, extend in both directions to find the extend
 	{
 		int dist = 0;	//starting new trace
 		TPointDouble curPt = pt;
-		TPointInt lastEdge;
+		TPointInt lastEdge = pt;
 		if (dir == 1)
 			step *= -1.0;
-		while (imageRect.contains(curPt)) //TODO: ensure that pt is contained in imageRect and avoid check
+		while (true)
 		{
 			curPt += step;
-			if (magnitude(curPt))
+			const TPointInt samplePt = curPt;
+			if (!imageRect.contains(samplePt))	//trace reached the image border (checking the rounded point, which is the one actually sampled)
+			{
+				if (dir == 0)
+					aBC.lastEdge = lastEdge;
+				else
+					aBC.firstEdge = lastEdge;
+				break;
+			}
+			if (magnitude(samplePt))
 			{
-				if (isAcceptable[orientation(curPt)])	//correctly oriented edge - increase count and reset distance
+				if (isAcceptable[orientation(samplePt)])	//correctly oriented edge - increase count and reset distance
 				{
-					lastEdge = curPt;
+					lastEdge = samplePt;
 					dist = 0;
 					aBC.nEdges++;
+					magnitudeSum += magnitude(samplePt);
+					nEdgePixels++;
 				}
 				else if (aBC.nEdges > 0)	//unacceptable edge during trace - increase distance and decrease count
 				{
@@ -282,6 +342,12 @@ bool BarcodeLocator::scanSegment(BarcodeCandidate &aBC, const TPointInt &pt)
 			}
 			else if (aBC.nEdges > 0)
 				dist++;	//no edge but tracing, just increase distance
+			if (aBC.nEdges > 0)	//tracing
+			{
+				TUInt8 curIntensity = intensity(samplePt);
+				minIntensity = min(minIntensity, curIntensity);
+				maxIntensity = max(maxIntensity, curIntensity);
+			}
 			if (dist > opts_.maxDistBtwEdges) //if no correctly oriented TPointInt seen in a while, end trace
 			{
 				if (dir == 0)
@@ -292,6 +358,9 @@ bool BarcodeLocator::scanSegment(BarcodeCandidate &aBC, const TPointInt &pt)
 			}
 		} //switch direction
 	}
+	//A step edge of height c has a gradient magnitude of about c / sqrt(2), see prepareGradientCalculator()
+	aBC.contrast = (maxIntensity > minIntensity ? maxIntensity - minIntensity : 0);
+	aBC.sharpness = ( (nEdgePixels > 0) && (aBC.contrast > 0) ? sqrt(2.0) * magnitudeSum / (nEdgePixels * aBC.contrast) : 0);
 	//See if the "edge density" is above the threshold, and save if it is.
 	LOGD("Barcode detected at (%d,%d) and orientation %d has %d edges\n", pt.x, pt.y, aBC.orientation, aBC.nEdges);
 	//TODO: check the following line!!
@@ -408,7 +477,9 @@ BarcodeLocator::ImageContainer::ImageContainer(const TMatrixUInt8 &img, const Ba
 		tmp1(outputSize.width, outputSize.height),	//temporary areas are transposed
 		tmp2(outputSize.width, outputSize.height),
 		gradientOrientationMap(MAX_GRAD - MIN_GRAD + 1, MAX_GRAD - MIN_GRAD + 1),
-		gradientMagnitudeMap(MAX_GRAD - MIN_GRAD + 1, MAX_GRAD - MIN_GRAD + 1)
+		gradientMagnitudeMap(MAX_GRAD - MIN_GRAD + 1, MAX_GRAD - MIN_GRAD + 1),
+		nScaledRows_(0),
+		nGradientRows_(0)
 {
 	prepareGradientCalculator(opts.gradThresh, 2 * opts.nOrientations);
 }
@@ -450,22 +521,46 @@ void BarcodeLocator::ImageContainer::update()
 }
 
 void BarcodeLocator::ImageContainer::subsample(const TMatrixUInt8 &input, TMatrixUInt8 &output, TUInt scale)
+{
+	LOGD("Subsampling image from %dx%d to %dx%d\n", input.rows, input.cols, output.rows, output.cols);
+	subsampleRows(input, output, scale, 0, output.rows);
+}
+
+void BarcodeLocator::ImageContainer::subsampleRows(const TMatrixUInt8 &input, TMatrixUInt8 &output, TUInt scale, TUInt rowBegin, TUInt rowEnd)
 {
 	assert(scale > 0);	//should only be used if scale is nonzero
 	assert( (output.rows == (input.rows >> scale)) && (output.cols == (input.cols >> scale)) );	//make sure output is correct size
-	TUInt M = input.rows, N = input.cols;
-	LOGD("Subsampling image from %dx%d to %dx%d\n", M, N, output.rows, output.cols);
-	//Subsample image
-	TUInt step = 1 << scale;
+	//Subsample image, the output size determines the extent since the input size need not be a multiple of the step
+	TUInt step = 1 << scale, NOut = output.cols;
 	const TUInt8 *data;
 	TUInt8 *dataScaled;
-	for (TUInt i = 0, ii = 0; i < M; i+= step, ii++) //TODO: speed up this step
+	for (TUInt ii = rowBegin; ii < rowEnd; ii++) //TODO: speed up this step
 	{
-		data = input[i];
+		data = input[ii << scale];
 		dataScaled = output[ii];
-		for (TUInt j = 0, jj = 0; j < N; j += step, jj++)
-			dataScaled[jj] = data[j];
+		for (TUInt jj = 0; jj < NOut; jj++, data += step)
+			dataScaled[jj] = *data;
+	}
+}
+
+TUInt BarcodeLocator::ImageContainer::updateRows(TUInt nInputRows)
+{
+	const TUInt M = outputSize.height;
+	//Subsample new rows if needed
+	TUInt nScaledRows = min(M, (nInputRows + (1 << scale) - 1) >> scale);
+	if (isSubsampled() && (nScaledRows > nScaledRows_))
+		subsampleRows(original, scaled, scale, nScaledRows_, nScaledRows);
+	nScaledRows_ = nScaledRows;
+	//Gradient row i is calculated from rows i..i+2. The last two rows do not have enough support and are left at zero,
+	//so they are ready only once the whole image is available
+	TUInt nGradientRows = (nScaledRows_ == M ? M : (nScaledRows_ > 2 ? nScaledRows_ - 2 : 0));
+	if (nGradientRows > nGradientRows_)
+	{
+		calculateGradientRows(isSubsampled() ? scaled : original, dMag, dAng, nGradientRows_, nGradientRows,
+				gradientMagnitudeMap, gradientOrientationMap);
+		nGradientRows_ = nGradientRows;
 	}
+	return nGradientRows_;
 }
 
 void BarcodeLocator::ImageContainer::calculateGradients(const TMatrixUInt8& input)
@@ -513,16 +608,15 @@ void BarcodeLocator::ImageContainer::calculateScharrGradients(const TMatrixUInt8
 	// INTERIOR
 	//----------------
 	//HORIZONTAL - we store the results in a transposed form to speed up the next stage (i.e. improve caching)
-	const TUInt8 *imgRowBegin = img[0], *imgRowEnd = img[0] + N - 3;
 	TInt *tmp1ColBegin = tmp1[1], *tmp2ColBegin = tmp2[1];
 	//VERTICAL - becomes horizontal on transposed tmp matrices (improved caching)
 	TInt *tmp1RowBegin = tmp1[0], *tmp1RowEnd = tmp1[0] + M - 3;
 	TInt *tmp2RowBegin = tmp2[0], *tmp2RowEnd = tmp2[0] + M - 3;
 	TInt *iGradColBegin = iGrad[0] + 1, *jGradColBegin = jGrad[0] + 1;
-	//for each row of image -> column of tmp
-	for (const TUInt8* imgRowBeginFinal = img[M-1]; imgRowBegin <= imgRowBeginFinal;
-			imgRowBegin += pyStep, imgRowEnd += pyStep, tmp1ColBegin++, tmp2ColBegin++)
+	//for each row of image -> column of tmp. Rows are addressed individually since img may be a region of a larger image.
+	for (TUInt i = 0; i < M; i++, tmp1ColBegin++, tmp2ColBegin++)
 	{
+		const TUInt8 *imgRowBegin = img[i], *imgRowEnd = imgRowBegin + N - 3;
 		tmp1Data = tmp1ColBegin;
 		tmp2Data = tmp2ColBegin;
 		//for each column of image -> row of tmp
@@ -574,6 +668,43 @@ void BarcodeLocator::ImageContainer::calculatePolarGradients(const TMatrixInt &i
 	}
 }
 
+void BarcodeLocator::ImageContainer::calculateGradientRows(const TMatrixUInt8 &img, TMatrixUInt8 &absGrad, TMatrixUInt8 &angGrad,
+		TUInt rowBegin, TUInt rowEnd, const TMatrixUInt8 &magnitudeLookup, const TMatrixUInt8 &orientationLookup)
+{
+	assert( (absGrad.rows == img.rows) && (absGrad.cols == img.cols) );
+	assert( (angGrad.rows == img.rows) && (angGrad.cols == img.cols) );
+	const TUInt M = img.rows, N = img.cols;
+	//Same conventions as calculateScharrGradients() + calculatePolarGradients(): gradient (i,j) is centered at pixel (i+1,j-1),
+	//the first two columns and the row M-2 have zero gradients, and row M-1 and column N-1 are left untouched.
+	const TUInt8 zeroMagnitude = magnitudeLookup(-MIN_GRAD, -MIN_GRAD), zeroOrientation = orientationLookup(-MIN_GRAD, -MIN_GRAD);
+	for (TUInt i = rowBegin; (i < rowEnd) && (i < M-1); i++)
+	{
+		TUInt8 *absGradData = absGrad[i], *angGradData = angGrad[i];
+		absGradData[0] = absGradData[1] = zeroMagnitude;
+		angGradData[0] = angGradData[1] = zeroOrientation;
+		if (i == M-2)
+		{
+			for (TUInt j = 2; j < N-1; j++)
+			{
+				absGradData[j] = zeroMagnitude;
+				angGradData[j] = zeroOrientation;
+			}
+			continue;
+		}
+		const TUInt8 *row0 = img[i], *row1 = img[i+1], *row2 = img[i+2];
+		for (TUInt j = 2; j < N-1; j++)
+		{
+			//horizontal derivative and smoothing of each of the three rows, then vertical smoothing and derivative
+			TInt dj0 = (TInt) row0[j-2] - (TInt) row0[j], dj1 = (TInt) row1[j-2] - (TInt) row1[j], dj2 = (TInt) row2[j-2] - (TInt) row2[j];
+			TInt s0 = 3 * (TInt) row0[j-2] + 10 * (TInt) row0[j-1] + 3 * (TInt) row0[j];
+			TInt s2 = 3 * (TInt) row2[j-2] + 10 * (TInt) row2[j-1] + 3 * (TInt) row2[j];
+			TInt curDI = (s0 - s2) / 16 - MIN_GRAD, curDJ = (3 * dj0 + 10 * dj1 + 3 * dj2) / 16 - MIN_GRAD;
+			absGradData[j] = magnitudeLookup(curDI, curDJ);
+			angGradData[j] = orientationLookup(curDI, curDJ);
+		}
+	}
+}
+
 //==============================
 //
 // CELL
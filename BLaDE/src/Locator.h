@@ -109,6 +109,22 @@ public:
 	 */
 	void locate(BarcodeList &barcodes);
 
+	/**
+	 * Notifies the locator that the first rows of the image have been filled in, for images that arrive row by row.
+	 * Gradients and cell histograms are calculated for each cell row as soon as it is complete, so that only the
+	 * clustering and scanning stages remain to be done by locate() once the last row arrives.
+	 * If locate() is called before all rows have been pushed, the whole image is processed as usual.
+	 * Streaming restarts with the next frame after each call to locate().
+	 * @param[in] nRows number of rows of the image that are now available, counted from the top of the image
+	 */
+	void pushRows(TUInt nRows);
+
+	/**
+	 * Sharpness of the last located frame, as the mean gradient magnitude of the pixels in barcode-like cells.
+	 * @return sharpness of the last located frame, 0 if no barcode-like cells were found
+	 */
+	inline double sharpness() const {return sharpness_; };
+
 private:
 	/** Options used by barcode locator */
 	const BarcodeLocator::Options opts_;
@@ -146,6 +162,10 @@ private:
 		static const int MIN_GRAD = -255;
 		/** Maximum possible value if j gradient */
 		static const int MAX_GRAD = 255;
+		/** Number of rows of the scaled image that have been subsampled so far when streaming */
+		TUInt nScaledRows_;
+		/** Number of rows of the gradient magnitude and orientation images that have been calculated so far when streaming */
+		TUInt nGradientRows_;
 	public:
 		/**
 		 * Constructor
@@ -157,6 +177,19 @@ private:
 		 */
 		void update();
 
+		/**
+		 * Calculates the gradients for the rows that can be calculated from the available rows of the input.
+		 * Only the rows that have not already been calculated since the last call to resetRows() are processed.
+		 * @param[in] nInputRows number of rows of the input image that are available
+		 * @return number of rows of the magnitude and orientation images that are ready
+		 */
+		TUInt updateRows(TUInt nInputRows);
+
+		/**
+		 * Restarts the row by row calculation of the gradients for a new frame
+		 */
+		inline void resetRows() {nScaledRows_ = nGradientRows_ = 0; };
+
 		/**
 		 * Whether image is being subsampled
 		 */
@@ -172,7 +205,7 @@ private:
 		 * Returns a reference to the image used for processing
 		 * @return the image that is being used for gradient calculations
 		 */
-		inline const TMatrixUInt8& get() const {return (isSubsampled() ? original : scaled); };
+		inline const TMatrixUInt8& get() const {return (isSubsampled() ? scaled : original); };
 
 		/**
 		 * Magnitude image
@@ -192,6 +225,16 @@ private:
 		 */
 		static void subsample(const TMatrixUInt8 &input, TMatrixUInt8 &output, TUInt scale);
 
+		/**
+		 * Subsamples a range of rows of the image
+		 * @param[in] input input image
+		 * @param[out] output subsampled image
+		 * @param[in] scale subsampling scale
+		 * @param[in] rowBegin first row of output to calculate
+		 * @param[in] rowEnd one past the last row of output to calculate
+		 */
+		static void subsampleRows(const TMatrixUInt8 &input, TMatrixUInt8 &output, TUInt scale, TUInt rowBegin, TUInt rowEnd);
+
 		/**
 		 * Prepares the lookup tables and containers for the gradient calculations
 		 * @param[in] thresh minimum threshold for a gradient magnitude - anything lower *in magnitude* is suppressed to zero.
@@ -226,6 +269,21 @@ private:
 		 */
 		static void calculatePolarGradients(const TMatrixInt &iGrad, const TMatrixInt &jGrad,
 				TMatrixUInt8 &absGrad, TMatrixUInt8 &angGrad, const TMatrixUInt8 &magnitudeLookup, const TMatrixUInt8 &orientationLookup);
+
+		/**
+		 * Calculates polar gradients for a range of rows directly from the image, without the intermediate rectangular gradients.
+		 * The results are identical to those of calculateScharrGradients() followed by calculatePolarGradients().
+		 * Row i of the output requires rows i..i+2 of the input.
+		 * @param[in] img image to calculate the gradients on.
+		 * @param[out] absGrad matrix to return gradient magnitudes in - scaled to fit in an 8 bit unsigned integer.
+		 * @param[out] angGrad matrix to return gradient angles in.
+		 * @param[in] rowBegin first row to calculate
+		 * @param[in] rowEnd one past the last row to calculate
+		 * @param[in] magnitudeLookup lookup map to use to speed up magnitude scaling
+		 * @param[in] orientationLookup lookup map to use to speed up orientation quantization
+		 */
+		static void calculateGradientRows(const TMatrixUInt8 &img, TMatrixUInt8 &absGrad, TMatrixUInt8 &angGrad,
+				TUInt rowBegin, TUInt rowEnd, const TMatrixUInt8 &magnitudeLookup, const TMatrixUInt8 &orientationLookup);
 	} image_;
 
 	/**
@@ -245,6 +303,12 @@ private:
 		/** last edge of this barcode segment */
 		TPointInt lastEdge;
 
+		/** sharpness of the edges of this barcode segment, see Barcode::sharpness */
+		double sharpness;
+
+		/** contrast along this barcode segment, see Barcode::contrast */
+		double contrast;
+
 		/**
 		 * Constructor
 		 * @param[in] o orientation
@@ -255,7 +319,9 @@ private:
 			nEdges(0),
 			orientation(o),
 			firstEdge(pt1),
-			lastEdge(pt2)
+			lastEdge(pt2),
+			sharpness(0),
+			contrast(0)
 		{};
 
 		/**
@@ -284,7 +350,11 @@ private:
 		inline Barcode promote(TUInt scale) const
 		{
 			int multiplier = (1 << scale);
-			return Barcode(	firstEdge * multiplier, lastEdge * multiplier);
+			Barcode bc(firstEdge * multiplier, lastEdge * multiplier);
+			bc.sharpness = sharpness;
+			bc.contrast = contrast;
+			bc.edgeDensity = (width() > 0 ? nEdges / width() : 0);
+			return bc;
 		}
 	};
 
@@ -379,6 +449,18 @@ private:
 	 */
 	void calculateCellHistograms();
 
+	/**
+	 * Clears the histograms of all cells
+	 */
+	void resetCellHistograms();
+
+	/**
+	 * Adds the votes of the pixels in a range of rows to the histograms of their cells
+	 * @param[in] rowBegin first row to add
+	 * @param[in] rowEnd one past the last row to add
+	 */
+	void accumulateCellHistograms(TUInt rowBegin, TUInt rowEnd);
+
 	/**
 	 * Calculates the image orientation histogram from cell histograms.
 	 */
@@ -462,6 +544,15 @@ private:
 	/** Acceptable angles for a given orientation */
 	TMatrixBool isAcceptable_;
 
+	/** Sharpness of the last located frame */
+	double sharpness_;
+
+	/** Number of rows of the current frame pushed so far when streaming */
+	TUInt nStreamedRows_;
+
+	/** Number of rows of cells whose histograms are complete when streaming */
+	TUInt nStreamedCellRows_;
+
 };
 
 #endif //BARCODE_LOCATOR_H_
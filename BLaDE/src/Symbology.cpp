@@ -46,6 +46,27 @@ BarcodeSymbology::Symbol::Symbol(TUInt aWidth, int dataSymbolIndex, vector<Bar*>
 {
 }
 
+//=========================================================
+//MirroredLayout
+//=========================================================
+namespace {
+/**
+ * Layout of a symbology read backwards
+ */
+class MirroredLayout: public BarcodeSymbology
+{
+public:
+	/**
+	 * Constructor
+	 * @param[in] original symbology to mirror
+	 */
+	MirroredLayout(const BarcodeSymbology &original): BarcodeSymbology(original.name()) {addMirroredSymbols(original); };
+
+	/** Mirrored layouts are only used for localization */
+	string estimate(const TMatEnergy &energies) const {return string(); };
+};
+}
+
 //=========================================================
 //BarcodeSymbology
 //=========================================================
@@ -77,6 +98,90 @@ BarcodeSymbology::Symbol* BarcodeSymbology::addSymbol(TUInt width, TUInt nBars,
 	return lastSymbol;
 }
 
+void BarcodeSymbology::addMirroredSymbols(const BarcodeSymbology &original)
+{
+	vector<TUInt> pattern;
+	for (list<Symbol>::const_reverse_iterator s = original.symbols_.rbegin(); s != original.symbols_.rend(); s++)
+	{
+		if (s->isDataSymbol())
+			addSymbol(s->width, s->bars.size());
+		else
+		{
+			pattern.clear();
+			for (vector<Bar*>::const_reverse_iterator b = s->bars.rbegin(); b != s->bars.rend(); b++)
+				pattern.push_back((*b)->width());
+			addSymbol(s->width, pattern.size(), &pattern[0]);
+		}
+	}
+}
+
+BarcodeSymbology::Signature BarcodeSymbology::signature() const
+{
+	Signature aSignature;
+	aSignature.nEdges = nTotalEdges();
+	aSignature.width = width();
+	if (!symbols_.front().isDataSymbol())
+	{
+		for (vector<Bar*>::const_iterator b = symbols_.front().bars.begin(); b != symbols_.front().bars.end(); b++)
+			aSignature.startGuard.push_back((*b)->width());
+	}
+	if (!symbols_.back().isDataSymbol())
+	{
+		for (vector<Bar*>::const_iterator b = symbols_.back().bars.begin(); b != symbols_.back().bars.end(); b++)
+			aSignature.endGuard.push_back((*b)->width());
+	}
+	return aSignature;
+}
+
+BarcodeSymbology::FlatLayout BarcodeSymbology::flatLayout() const
+{
+	FlatLayout aLayout;
+	aLayout.name = name_;
+	aLayout.nTotalEdges = nTotalEdges();
+	aLayout.width = width();
+	for (vector<Edge*>::const_iterator e = fixedEdges_.begin(); e != fixedEdges_.end(); e++)
+	{
+		aLayout.fixedEdgeIndices.push_back((*e)->index);
+		aLayout.fixedEdgeLocations.push_back((*e)->location);
+		aLayout.fixedEdgePolarities.push_back((*e)->polarity());
+	}
+	//The edges of the data symbols are fixed, and both the edges and the symbols are in order
+	TUInt e = 0;
+	for (vector<Symbol*>::const_iterator s = dataSymbols_.begin(); s != dataSymbols_.end(); s++)
+	{
+		aLayout.symbolWidths.push_back((*s)->width);
+		while (fixedEdges_[e] != (*s)->leftEdge())
+			e++;
+		aLayout.symbolLeftFixedEdges.push_back(e);
+		while (fixedEdges_[e] != (*s)->rightEdge())
+			e++;
+		aLayout.symbolRightFixedEdges.push_back(e);
+	}
+	return aLayout;
+}
+
+bool BarcodeSymbology::isSymmetric() const
+{
+	TUInt nFixedEdges = fixedEdges_.size(), nSymbols = dataSymbols_.size();
+	for (TUInt i = 0; i < nFixedEdges; i++)
+	{
+		if (fixedEdges_[i]->location + fixedEdges_[nFixedEdges - 1 - i]->location != (int) width())
+			return false;
+	}
+	for (TUInt i = 0; i < nSymbols; i++)
+	{
+		if ( (dataSymbols_[i]->width != dataSymbols_[nSymbols - 1 - i]->width)
+				|| (dataSymbols_[i]->bars.size() != dataSymbols_[nSymbols - 1 - i]->bars.size()) )
+			return false;
+	}
+	return true;
+}
+
+BarcodeSymbology* BarcodeSymbology::createMirroredLayout() const
+{
+	return new MirroredLayout(*this);
+}
+
 BarcodeSymbology::Bar* BarcodeSymbology::addBar(int rightEdgeLocation)
 {
 	Edge *left = (bars_.size() ? &(edges_.back()) : addEdge(0)); //add left edge of barcode if no previous edges exist.
@@ -110,8 +215,47 @@ const BarcodeSymbology::Symbol* BarcodeSymbology::getDataSymbol(TUInt i) const
 	return dataSymbols_[i];
 }
 
+TUInt BarcodeSymbology::nPatterns() const
+{
+	return 10;
+}
+
+TUInt BarcodeSymbology::patternSetSize() const
+{
+	return nPatterns();
+}
+
+TUInt BarcodeSymbology::nSymbolPatterns(TUInt i) const
+{
+	return nPatterns();
+}
+
+void BarcodeSymbology::getConvolutionPattern(TUInt digit, double x, bool isFlipped, vector<double> &pattern) const
+{
+	vector<TUInt> integralPattern;
+	getConvolutionPattern(digit, x, isFlipped, integralPattern);
+	pattern.assign(integralPattern.begin(), integralPattern.end());
+}
+
 void BarcodeSymbology::getConvolutionPattern(TUInt digit, double x, bool isFlipped, vector<TUInt> &pattern) const {}
 
+int BarcodeSymbology::darkModuleParity(TUInt i) const
+{
+	return -1;
+}
+
+void BarcodeSymbology::estimateBatch(const vector<const TMatEnergy*> &energies, BatchViterbi<TEnergy> &batch, vector<string> &estimates) const
+{
+	estimates.resize(energies.size());
+	for (TUInt b = 0; b < energies.size(); b++)
+		estimates[b] = estimate(*energies[b]);
+}
+
+const char* BarcodeSymbology::estimateName(const string &anEstimate) const
+{
+	return name_;
+}
+
 string BarcodeSymbology::convertEstimateToString(const vector<TUInt> &estimate) const
 {
 	string estimateStr;
@@ -34,7 +34,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "UPCASymbology.h"
 #include "ski/log.h"
+#include "ski/math.h"
+#include <cstring>
+#include <stdexcept>
+#ifdef _LIBTEST
 #include "ski/viterbi.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#endif
 
 const TUInt UpcaSymbology::digitPatterns_[10][SYMBOL_LENGTH_] =
 {
@@ -50,152 +58,353 @@ const TUInt UpcaSymbology::digitPatterns_[10][SYMBOL_LENGTH_] =
 		{3, 1, 1, 2}
 };
 
+const TUInt8 UpcaSymbology::digitFromStep_[2][10] =
+{
+		{0, 7, 4, 1, 8, 5, 2, 9, 6, 3},	//3 * digit = step (mod 10)
+		{0, 1, 2, 3, 4, 5, 6, 7, 8, 9}	//digit = step (mod 10)
+};
+
 UpcaSymbology::UpcaSymbology(const Options& opts/*=Options()*/) :
 		BarcodeSymbology("UPC-A"),
-		opts_(opts),
-		stateDigitMapForOddSymbol_(10,10),
-		stateDigitMapForEvenSymbol_(10,10)
+		opts_(opts)
+{
+	addUpcaSymbols(N_DIGITS_);
+	LOGD("UPCA Symbology created\n");
+}
+
+UpcaSymbology::UpcaSymbology(const char name[], const Options &opts) :
+		BarcodeSymbology(name),
+		opts_(opts)
+{
+}
+
+void UpcaSymbology::addUpcaSymbols(TUInt nDigits)
 {
-	//Set up symbology
 	static const TUInt endBand[] = {1, 1, 1};
 	static const TUInt midBand[] = {1, 1, 1, 1, 1};
 	addSymbol(3, 3, endBand);
-	for (TUInt n = 0; n < 6; n++)
+	for (TUInt n = 0; n < nDigits / 2; n++)
 		addSymbol(7, 4);
 	addSymbol(5, 5, midBand);
-	for (TUInt n = 0; n < 6; n++)
+	for (TUInt n = 0; n < nDigits / 2; n++)
 		addSymbol(7, 4);
 	addSymbol(3, 3, endBand);
-
-	//Set up joint decoder
-	for (TUInt prevState = 0; prevState < 10; prevState++)
-	{
-		TUInt *odd = stateDigitMapForOddSymbol_[prevState];
-		TUInt *even = stateDigitMapForEvenSymbol_[prevState];
-		for (TUInt digit = 0; digit < 10; digit++)
-		{
-			odd[(3 * digit + prevState) % 10] = digit;
-			even[(digit + prevState) % 10] = digit;
-		}
-	}
-	LOGD("UPCA Symbology created\n");
 }
 
 UpcaSymbology::~UpcaSymbology() {}
 
-void UpcaSymbology::getConvolutionPattern(TUInt digit, double x, bool isFlipped, vector<TUInt> &pattern) const
+void UpcaSymbology::getConvolutionPattern(TUInt digit, double x, bool isFlipped, vector<double> &pattern) const
 {
+	//Even parity digit patterns are the reverses of the odd parity ones
+	if (digit >= 10)
+	{
+		digit -= 10;
+		isFlipped = !isFlipped;
+	}
 	pattern.resize(SYMBOL_LENGTH_ + 2);
 	const TUInt *dP = digitPatterns_[digit];
 	if (isFlipped)
 		dP += SYMBOL_LENGTH_ - 1;
-	vector<TUInt>::iterator p = pattern.begin();
+	vector<double>::iterator p = pattern.begin();
 	//extend one X prior to symbol
 	double width = x;
-	*p = (TUInt) x;
+	*p = x;
 	//digit pattern in symbol
 	for (p++; p != pattern.end() - 1; p++)
 	{
 		width += (*dP) * x;
-		*p = (TUInt) width;
+		*p = width;
 		isFlipped ? dP-- : dP++;
 	}
 	//extend one X past symbol
-	*p = (TUInt) (width + x);
+	*p = width + x;
 }
 
-inline TUInt UpcaSymbology::getDigitFromStates(TUInt prevState, TUInt curState, TUInt symbol) const
+int UpcaSymbology::darkModuleParity(TUInt i) const
 {
-	return (symbol%2 == 0 ? stateDigitMapForOddSymbol_(prevState, curState) : stateDigitMapForEvenSymbol_(prevState, curState));
+	return (i < nDataSymbols() / 2 ? 1 : 0);
 }
 
-string UpcaSymbology::estimate(const TMatEnergy &energies) const
+TEnergy UpcaSymbology::solveChecksum(const TMatEnergy &energies, TUInt n, TUInt *digits, TEnergy &secondBestEnergy)
 {
-	//-----------
-	//Joint Viterbi estimation
-	//-----------
-	string upcaStr;
-	static vector<vector<TEnergy> > priors;
-	static vector<TMatEnergy> conditionals;
-	TUInt nSymbols = nDataSymbols();
-	if (priors.size() == 0)
+	static const TUInt rows[N_DIGITS_] = {};
+	TEnergy pathEnergies[10][2];
+	TUInt8 backPointers[N_DIGITS_][10];
+	solveChecksumPaths(energies, 0, n, rows, 0, pathEnergies, backPointers);
+	//Backtrack the best path from a checksum of 0
+	backtrackChecksum(0, n, backPointers, 0, digits);
+	secondBestEnergy = pathEnergies[0][1];
+	return pathEnergies[0][0];
+}
+
+void UpcaSymbology::solveChecksumPaths(const TMatEnergy &energies, TUInt first, TUInt n, const TUInt *rows, TUInt initialState,
+		TEnergy (&pathEnergies)[10][2], TUInt8 (*backPointers)[10])
+{
+	//pathEnergies[state][k] is the energy of the k'th best digit sequence so far with checksum state (mod 10).
+	//backPointers[t][state] is the previous state of the best path into state at symbol first + t.
+	//The prefixes of a best path are best paths themselves, so second best paths need not be backtracked.
+	TEnergy prevPathEnergies[10][2];
+	const TUInt8 *fromStep = digitFromStep_[first % 2];
+	for (TUInt step = 0; step < 10; step++)
 	{
-		priors.assign(nSymbols, vector<TEnergy>(10, (TEnergy) 0));
-		conditionals.clear();
-		conditionals.reserve(nSymbols - 1);
-		for (TUInt i = 0; i < nSymbols - 1; i++)
-			conditionals.push_back(TMatEnergy(10, 10, (TEnergy) 0));
+		TUInt state = (initialState + step) % 10;
+		pathEnergies[state][0] = energies(rows[0] + fromStep[step], first);
+		pathEnergies[state][1] = ski::MaxValue<TEnergy>() / 2;
+		backPointers[0][state] = (TUInt8) initialState;
 	}
-	//single Energies
-	vector<TEnergy> &prior = priors.front();
-	for (TUInt curState = 0; curState < 10; curState++)
-		prior[curState] = energies(getDigitFromStates(0, curState, 0), 0);
-	//Conditionals
-	for (TUInt t = 1; t < nSymbols; t++)
+	for (TUInt t = 1; t < n; t++)
 	{
-		TMatEnergy cond = conditionals[t-1];
+		memcpy(prevPathEnergies, pathEnergies, sizeof(pathEnergies));
+		//Energy of the digit that adds each step to the checksum, repeated so that the steps from any previous state are contiguous
+		TEnergy stepEnergies[20];
+		fromStep = digitFromStep_[(first + t) % 2];
+		for (TUInt step = 0; step < 10; step++)
+			stepEnergies[step] = stepEnergies[step + 10] = energies(rows[t] + fromStep[step], first + t);
+		//The second path into a previous state is never better than its first, so the best two paths into a state are
+		//the best two first paths, unless the second path of the best previous state beats the runner up.
+		TEnergy best[10], secondBest[10];
+		TUInt8 bestFrom[10];
+		for (TUInt state = 0; state < 10; state++)
+		{
+			best[state] = secondBest[state] = ski::MaxValue<TEnergy>();
+			bestFrom[state] = 0;
+		}
 		for (TUInt prevState = 0; prevState < 10; prevState++)
 		{
-			TEnergy *c = cond[prevState];
-			for (TUInt curState = 0; curState < 10; curState++)
-				c[curState] = energies(getDigitFromStates(prevState, curState, t), t);
+			const TEnergy *steps = stepEnergies + 10 - prevState, prevEnergy = prevPathEnergies[prevState][0];
+			for (TUInt state = 0; state < 10; state++)
+			{
+				//Branch free, as which previous state is best is unpredictable
+				TEnergy energy = steps[state] + prevEnergy;
+				int isBest = (energy < best[state] ? 1 : 0);
+				secondBest[state] = min(secondBest[state], max(best[state], energy));
+				bestFrom[state] = (TUInt8) (bestFrom[state] + isBest * ((int) prevState - bestFrom[state]));
+				best[state] = min(best[state], energy);
+			}
+		}
+		for (TUInt state = 0; state < 10; state++)
+		{
+			TUInt prevState = bestFrom[state];
+			pathEnergies[state][0] = best[state];
+			pathEnergies[state][1] = min(secondBest[state], stepEnergies[state + 10 - prevState] + prevPathEnergies[prevState][1]);
+			backPointers[t][state] = bestFrom[state];
 		}
 	}
+}
 
-	vector<TUInt> upcaEstimate;
-	try
+TUInt UpcaSymbology::backtrackChecksum(TUInt first, TUInt n, const TUInt8 (*backPointers)[10], TUInt finalState, TUInt *digits)
+{
+	TUInt state = finalState;
+	for (TUInt t = n; t-- > 0; )
 	{
-		static Viterbi<TEnergy> V(priors, conditionals, 2);
-		V.solve(0);
-		vector<int> &bestseq = V.solutions[0].sequence;
-		int prevState, curState = 0;
-		upcaEstimate.resize(nSymbols);	//TODO: change bc struct
-		for (TUInt t = 0; t < nSymbols; t++)
+		TUInt prevState = backPointers[t][state];
+		digits[t] = digitFromStep_[(first + t) % 2][(state + 10 - prevState) % 10];
+		state = prevState;
+	}
+	return state;
+}
+
+bool UpcaSymbology::isVerified(const TMatEnergy &energies, const TUInt *patterns, TEnergy bestEnergy, TEnergy secondBestEnergy,
+		const string &estimateStr) const
+{
+	//Margin test
+	double margin = (secondBestEnergy - bestEnergy) / ((double) bestEnergy);
+	if (margin < opts_.minMargin)
+	{
+		LOGD("Barcode estimate %s failed margin test (%f < %f)\n", estimateStr.c_str(), margin, opts_.minMargin);
+		return false;
+	}
+	//Individual most likely patterns within their sets
+	int nDifferentPatterns = 0;
+	TUInt setSize = patternSetSize(), nSymbols = nDataSymbols();
+	for (TUInt symbol = 0; symbol < nSymbols; symbol++)
+	{
+		TUInt estimatedPattern = patterns[symbol], set = estimatedPattern - estimatedPattern % setSize;
+		for (TUInt pattern = set; pattern < set + setSize; pattern++)
 		{
-			prevState = curState;
-			curState = bestseq[t];
-			upcaEstimate[t] = getDigitFromStates(prevState, curState, t);
+			if ( (pattern != estimatedPattern) && (energies(pattern, symbol) < energies(estimatedPattern, symbol)) )
+			{
+				nDifferentPatterns++;
+				break;
+			}
 		}
-
-		//-----------
-		//Checks
-		//-----------
-		//Margin test
-		double margin = (V.solutions[1].energy - V.solutions[0].energy) / ((double) V.solutions[0].energy);
-
-		if (margin < opts_.minMargin)
+		if (nDifferentPatterns > 1)
 		{
-			LOGD("Barcode estimate %s failed margin test (%f < %f)\n", convertEstimateToString(upcaEstimate).c_str(), margin, opts_.minMargin);
-			return upcaStr;
+			LOGD("Barcode estimate %s failed parity constraint (more than 1 digit is not most likely)\n", estimateStr.c_str());
+			return false;
 		}
-		//Individual most likely digits
-		int nDifferentDigits = 0;
-		for (TUInt symbol = 0; symbol < nSymbols; symbol++)
+	}
+	//Passed both checks
+	LOGD("Estimated barcode %s with energy = %f, margin = %4.3f\n", estimateStr.c_str(), (double) bestEnergy, margin);
+	return true;
+}
+
+string UpcaSymbology::estimate(const TMatEnergy &energies) const
+{
+	//-----------
+	//Joint estimation with the check digit
+	//-----------
+	const TUInt nDigits = nDataSymbols();
+	if (nDigits > N_DIGITS_)
+		throw logic_error("UpcaSymbology: unexpected number of data symbols");
+	TUInt upcaEstimate[N_DIGITS_];
+	TEnergy secondBestEnergy;
+	TEnergy bestEnergy = solveChecksum(energies, nDigits, upcaEstimate, secondBestEnergy);
+	string upcaStr(nDigits, '0');
+	for (TUInt symbol = 0; symbol < nDigits; symbol++)
+		upcaStr[symbol] += (char) upcaEstimate[symbol];
+
+	//-----------
+	//Checks
+	//-----------
+	return (isVerified(energies, upcaEstimate, bestEnergy, secondBestEnergy, upcaStr) ? upcaStr : string());
+}
+
+void UpcaSymbology::estimateBatch(const vector<const TMatEnergy*> &energies, BatchViterbi<TEnergy> &batch, vector<string> &estimates) const
+{
+	//The same joint estimation with the check digit as estimate(), each barcode being a chain over the checksum states
+	const TUInt nDigits = nDataSymbols(), nBarcodes = energies.size();
+	if (nDigits > N_DIGITS_)
+		throw logic_error("UpcaSymbology: unexpected number of data symbols");
+	if (batch.nPaths() < 2)
+		throw invalid_argument("UpcaSymbology: the batch must find two paths for the margin test");
+	estimates.resize(nBarcodes);
+	if (nBarcodes == 0)
+		return;
+	//Only resize when the shape changes, as the workspace is kept from call to call
+	if ( (batch.nChains() != (int) nBarcodes) || (batch.time() != (int) nDigits) )
+		batch.resize(nBarcodes, vector<int>(nDigits, 10));
+	for (TUInt b = 0; b < nBarcodes; b++)
+	{
+		const TMatEnergy &barcodeEnergies = *energies[b];
+		//The first digit moves the checksum from 0 by its step, and each following digit from the previous state
+		for (TUInt state = 0; state < 10; state++)
+			batch.prior(0, state)[b] = barcodeEnergies(digitFromStep_[0][state], 0);
+		for (TUInt t = 1; t < nDigits; t++)
 		{
-			TUInt estimatedDigit = upcaEstimate[symbol];
-			for (TUInt digit = 1; digit < 10; digit++)
+			for (TUInt state = 0; state < 10; state++)
+				batch.prior(t, state)[b] = 0;
+			for (TUInt prevState = 0; prevState < 10; prevState++)
 			{
-				if ( (digit != estimatedDigit) && (energies(digit, symbol) < energies(estimatedDigit, symbol)) )
-				{
-					nDifferentDigits++;
-					break;
-				}
+				for (TUInt state = 0; state < 10; state++)
+					batch.conditional(t, prevState, state)[b] = barcodeEnergies(digitFromStep_[t % 2][(state + 10 - prevState) % 10], t);
 			}
-			if (nDifferentDigits > 1)
+		}
+	}
+	batch.solve(0);
+	TUInt upcaEstimate[N_DIGITS_];
+	for (TUInt b = 0; b < nBarcodes; b++)
+	{
+		const BatchViterbi<TEnergy>::Solution &best = batch.solutions[b * batch.nPaths()], &secondBest = batch.solutions[b * batch.nPaths() + 1];
+		string upcaStr(nDigits, '0');
+		for (TUInt t = 0, prevState = 0; t < nDigits; prevState = best.sequence[t], t++)
+		{
+			upcaEstimate[t] = digitFromStep_[t % 2][(best.sequence[t] + 10 - prevState) % 10];
+			upcaStr[t] += (char) upcaEstimate[t];
+		}
+		estimates[b] = (isVerified(*energies[b], upcaEstimate, best.energy, secondBest.energy, upcaStr) ? upcaStr : string());
+	}
+}
+
+#ifdef _LIBTEST
+
+void testUpcaChecksum()
+{
+	//Compares solveChecksum with the generic two path Viterbi over the checksum states on random digit energies
+	const TUInt N = UpcaSymbology::N_DIGITS_;
+	const int nTrials = 20000;
+	vector<vector<TEnergy> > priors(N, vector<TEnergy>(10, (TEnergy) 0));
+	vector<TMatEnergy> conditionals;
+	for (TUInt t = 0; t < N - 1; t++)
+		conditionals.push_back(TMatEnergy(10, 10, (TEnergy) 0));
+	Viterbi<TEnergy> V(priors, conditionals, 2);
+	TMatEnergy energies(10, N);
+	TUInt digits[N];
+	TEnergy secondBestEnergy;
+	double genericTime = 0, specializedTime = 0;
+	int nMismatches = 0;
+	srand(1);
+	for (int trial = 0; trial < nTrials; trial++)
+	{
+		for (TUInt d = 0; d < 10; d++)
+		{
+			for (TUInt t = 0; t < N; t++)
+				energies(d, t) = 5.0 * rand() / RAND_MAX;
+		}
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (TUInt state = 0; state < 10; state++)
+			priors[0][state] = energies(UpcaSymbology::digitFromStep_[0][state], 0);
+		for (TUInt t = 1; t < N; t++)
+		{
+			for (TUInt prevState = 0; prevState < 10; prevState++)
 			{
-				LOGD("Barcode estimate %s failed parity constraint (more than 1 digit is not most likely)\n", convertEstimateToString(upcaEstimate).c_str());
-				return upcaStr;
+				for (TUInt state = 0; state < 10; state++)
+					conditionals[t-1](prevState, state) = energies(UpcaSymbology::digitFromStep_[t % 2][(state + 10 - prevState) % 10], t);
 			}
 		}
-		//Passed both checks -- convert to string
-		//for (vector<TUInt>::const_iterator iDigit = upcaEstimate.begin(); iDigit != upcaEstimate.end(); iDigit++)
-		//	upcaStr += ('0' + (char) *iDigit);
-		upcaStr = convertEstimateToString(upcaEstimate);
-		LOGD("Estimated barcode %s with energy = %f, margin = %4.3f\n", upcaStr.c_str(), (double) V.solutions[0].energy, margin);
+		V.solve(0);
+		std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+		TEnergy bestEnergy = UpcaSymbology::solveChecksum(energies, N, digits, secondBestEnergy);
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		genericTime += std::chrono::duration<double>(middle - start).count();
+		specializedTime += std::chrono::duration<double>(end - middle).count();
+		bool isSame = (bestEnergy == V.solutions[0].energy) && (secondBestEnergy == V.solutions[1].energy);
+		for (TUInt t = 0, prevState = 0; t < N; prevState = V.solutions[0].sequence[t], t++)
+			isSame = isSame && (digits[t] == UpcaSymbology::digitFromStep_[t % 2][(V.solutions[0].sequence[t] + 10 - prevState) % 10]);
+		nMismatches += (isSame ? 0 : 1);
 	}
-	catch (exception &aErr)
+	printf("UPC-A checksum: %d mismatches in %d trials, generic Viterbi %.2f us, specialized %.2f us per estimate\n",
+			nMismatches, nTrials, 1e6 * genericTime / nTrials, 1e6 * specializedTime / nTrials);
+}
+
+/**
+ * Compares estimateBatch with estimate on batches of noisy digit energies of random codes, and prints their timings per barcode
+ * @param[in] nBarcodes number of barcodes in each batch
+ */
+void testUpcaEstimateBatch(int nBarcodes)
+{
+	UpcaSymbology upca;
+	const TUInt N = upca.nDataSymbols();
+	const int nTrials = 20000 / nBarcodes;
+	BatchViterbi<TEnergy> batch(2);
+	vector<TMatEnergy> energies;
+	vector<const TMatEnergy*> pEnergies;
+	for (int b = 0; b < nBarcodes; b++)
+		energies.push_back(TMatEnergy(10, N));
+	for (int b = 0; b < nBarcodes; b++)
+		pEnergies.push_back(&energies[b]);
+	vector<string> estimates, batchEstimates;
+	double singleTime = 0, batchTime = 0;
+	int nMismatches = 0, nVerified = 0;
+	srand(1);
+	for (int trial = 0; trial < nTrials; trial++)
 	{
-		throw aErr;
+		//The digits of a random code are favored over the others by less than the noise
+		for (int b = 0; b < nBarcodes; b++)
+		{
+			for (TUInt t = 0; t < N; t++)
+			{
+				TUInt digit = rand() % 10;
+				for (TUInt d = 0; d < 10; d++)
+					energies[b](d, t) = 3.0 * rand() / RAND_MAX + (d == digit ? 0 : 2);
+			}
+		}
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		estimates.resize(nBarcodes);
+		for (int b = 0; b < nBarcodes; b++)
+			estimates[b] = upca.estimate(energies[b]);
+		std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+		upca.estimateBatch(pEnergies, batch, batchEstimates);
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		singleTime += std::chrono::duration<double>(middle - start).count();
+		batchTime += std::chrono::duration<double>(end - middle).count();
+		for (int b = 0; b < nBarcodes; b++)
+		{
+			nMismatches += (estimates[b] == batchEstimates[b] ? 0 : 1);
+			nVerified += (estimates[b].empty() ? 0 : 1);
+		}
 	}
-	return upcaStr;
+	printf("UPC-A batches of %d: %d mismatches in %d estimates (%d verified), estimate %.2f us, estimateBatch %.2f us per barcode\n",
+			nBarcodes, nMismatches, nTrials * nBarcodes, nVerified, 1e6 * singleTime / (nTrials * nBarcodes), 1e6 * batchTime / (nTrials * nBarcodes));
 }
+#endif //LIBTEST
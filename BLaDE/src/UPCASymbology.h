@@ -69,12 +69,21 @@ public:
 
 	/**
 	 * Returns a convolution pattern to the decoder
-	 * @param[in] digit digit to return the pattern for
+	 * @param[in] digit digit to return the pattern for, or 10 + digit for the even parity patterns of the symbologies that use them,
+	 * which are the reverses of the odd parity patterns
 	 * @param[in] fundamental width
 	 * @param[in] whether the pattern is horizontally flipped
 	 * @param[out] pattern pattern to use for convolution.
 	 */
-	virtual void getConvolutionPattern(TUInt digit, double x, bool isFlipped, vector<TUInt> &pattern) const;
+	virtual void getConvolutionPattern(TUInt digit, double x, bool isFlipped, vector<double> &pattern) const;
+
+	/**
+	 * Parity of the number of dark modules in a data symbol.
+	 * Left half digits are encoded with odd parity, right half digits with even parity.
+	 * @param[in] i index of the data symbol
+	 * @return 1 for the left half, 0 for the right half
+	 */
+	virtual int darkModuleParity(TUInt i) const;
 
 	/**
 	 * Estimates the barcode from the matrix of digit energies for each symbol
@@ -83,23 +92,92 @@ public:
 	 */
 	string estimate(const TMatEnergy &energies) const;
 
+	/**
+	 * Estimates several barcodes, solving the checksum recursions of all of them together
+	 * @param[in] energies energies[b] is the matrix of digit energies per symbol of barcode b
+	 * @param[in,out] batch workspace of at least two paths, resized to the barcodes
+	 * @param[out] estimates estimates[b] is the estimate of barcode b, empty string if it fails verification
+	 */
+	virtual void estimateBatch(const vector<const TMatEnergy*> &energies, BatchViterbi<TEnergy> &batch, vector<string> &estimates) const;
+
 protected:
+	/**
+	 * Constructor for the symbologies that share the UPC-A digit patterns, which add their own layout
+	 * @param[in] name name of the symbology
+	 * @param[in] opts decoding options
+	 */
+	UpcaSymbology(const char name[], const Options &opts);
+
+	/**
+	 * Adds the guard bands and data symbols of the UPC-A layout
+	 * @param[in] nDigits number of data symbols, half of which are on each side of the middle guard band
+	 */
+	void addUpcaSymbols(TUInt nDigits);
+
 	/** Decoding options */
 	Options opts_;
 
-	/** Mapping from auxiliary variables to actual digits*/
-	TMatrixUInt stateDigitMapForOddSymbol_;
+	/** Number of data symbols of UPC-A, i.e. digits including the check digit, which no symbology sharing its digit patterns exceeds */
+	static const TUInt N_DIGITS_ = 12;
 
-	/** Mapping from auxiliary variables to actual digits*/
-	TMatrixUInt stateDigitMapForEvenSymbol_;
+	/**
+	 * Digit that moves the checksum by a given step modulo 10, for symbols weighted by 3 (even indices) and by 1 (odd indices)
+	 * digitFromStep_[t % 2][step] is the digit at symbol t that adds step to the checksum.
+	 */
+	static const TUInt8 digitFromStep_[2][10];
+
+	/**
+	 * Finds the two lowest energy digit sequences whose weighted sum is a multiple of 10, as the check digit requires.
+	 * The states are the running checksum modulo 10, and the two best paths into each state are kept in stack arrays.
+	 * @param[in] energies matrix of digit energies per symbol
+	 * @param[in] n number of symbols, at most N_DIGITS_
+	 * @param[out] digits lowest energy digit sequence, of n digits
+	 * @param[out] secondBestEnergy energy of the second lowest energy digit sequence
+	 * @return energy of the lowest energy digit sequence
+	 */
+	static TEnergy solveChecksum(const TMatEnergy &energies, TUInt n, TUInt *digits, TEnergy &secondBestEnergy);
+
+	/**
+	 * Finds the two lowest energy paths into each checksum state over consecutive symbols, starting from a given state.
+	 * Symbols at even indices are weighted by 3 and those at odd indices by 1.
+	 * @param[in] energies matrix of pattern energies per symbol
+	 * @param[in] first index of the first symbol
+	 * @param[in] n number of symbols
+	 * @param[in] rows rows[t] is the row of digit 0 of symbol first + t in energies, the other digits following it
+	 * @param[in] initialState checksum state before the first symbol
+	 * @param[out] pathEnergies pathEnergies[state][k] is the energy of the k'th best path into state (mod 10)
+	 * @param[out] backPointers backPointers[t][state] is the previous state of the best path into state at symbol first + t
+	 */
+	static void solveChecksumPaths(const TMatEnergy &energies, TUInt first, TUInt n, const TUInt *rows, TUInt initialState,
+			TEnergy (&pathEnergies)[10][2], TUInt8 (*backPointers)[10]);
+
+	/**
+	 * Backtracks the best path into a checksum state found by solveChecksumPaths()
+	 * @param[in] first index of the first symbol
+	 * @param[in] n number of symbols
+	 * @param[in] backPointers back pointers found by solveChecksumPaths()
+	 * @param[in] finalState checksum state to backtrack from
+	 * @param[out] digits digits[t] is the digit of symbol first + t
+	 * @return the initial checksum state
+	 */
+	static TUInt backtrackChecksum(TUInt first, TUInt n, const TUInt8 (*backPointers)[10], TUInt finalState, TUInt *digits);
 
 	/**
-	 * Returns the digit that results in transition from one state to the other for a given symbol
-	 * @param[in] prevState previous state
-	 * @param[in] curState current state
-	 * @param[in] symbol current symbol
+	 * Verifies an estimate by its energy margin over the second best estimate, and by the number of symbols
+	 * whose estimated pattern is not the individually most likely one of its pattern set.
+	 * @param[in] energies matrix of pattern energies per symbol
+	 * @param[in] patterns patterns[t] is the estimated pattern of data symbol t
+	 * @param[in] bestEnergy energy of the estimate
+	 * @param[in] secondBestEnergy energy of the second best estimate
+	 * @param[in] estimateStr estimate, for logging
+	 * @return true if the estimate passes verification
 	 */
-	inline TUInt getDigitFromStates(TUInt prevState, TUInt curState, TUInt symbol) const;
+	bool isVerified(const TMatEnergy &energies, const TUInt *patterns, TEnergy bestEnergy, TEnergy secondBestEnergy,
+			const string &estimateStr) const;
+
+#ifdef _LIBTEST
+	friend void testUpcaChecksum();
+#endif
 
 	/** Number of bars in each symbol */
 	static const TUInt SYMBOL_LENGTH_ = 4;
@@ -0,0 +1,239 @@
+/*
+Copyright (c) 2012, The Smith-Kettlewell Eye Research Institute
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the The Smith-Kettlewell Eye Research Institute nor
+      the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE SMITH-KETTLEWELL EYE RESEARCH INSTITUTE BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file UPCESymbology.cpp
+ * UPC-E symbology, the zero suppressed form of UPC-A.
+ * @author Ender Tekin
+ */
+
+#include "UPCESymbology.h"
+#include "ski/log.h"
+#include "ski/math.h"
+#include <algorithm>
+#include <stdexcept>
+
+const TUInt UpceSymbology::isEvenParity_[10][N_UPCE_DIGITS_] =
+{
+		{1, 1, 1, 0, 0, 0},
+		{1, 1, 0, 1, 0, 0},
+		{1, 1, 0, 0, 1, 0},
+		{1, 1, 0, 0, 0, 1},
+		{1, 0, 1, 1, 0, 0},
+		{1, 0, 0, 1, 1, 0},
+		{1, 0, 0, 0, 1, 1},
+		{1, 0, 1, 0, 1, 0},
+		{1, 0, 1, 0, 0, 1},
+		{1, 0, 0, 1, 0, 1}
+};
+
+//The expanded UPC-A code is, depending on the last digit d6:
+//d6 = 0-2: NS d1 d2 d6 0 0 0 0 d3 d4 d5 C
+//d6 = 3:   NS d1 d2 d3 0 0 0 0 0 d4 d5 C
+//d6 = 4:   NS d1 d2 d3 d4 0 0 0 0 0 d5 C
+//d6 = 5-9: NS d1 d2 d3 d4 d5 0 0 0 0 d6 C
+//and the number system NS is weighted by 3.
+const TUInt8 UpceSymbology::checksumWeights_[N_EXPANSIONS_][N_UPCE_DIGITS_] =
+{
+		{1, 3, 3, 1, 3, 1},
+		{1, 3, 1, 1, 3, 0},
+		{1, 3, 1, 3, 3, 0},
+		{1, 3, 1, 3, 1, 3}
+};
+
+const TUInt UpceSymbology::lastDigits_[N_EXPANSIONS_][2] =
+{
+		{0, 2},
+		{3, 3},
+		{4, 4},
+		{5, 9}
+};
+
+UpceSymbology::UpceSymbology(const Options &opts/*=Options()*/) :
+		UpcaSymbology("UPC-E", opts)
+{
+	static const TUInt startBand[] = {1, 1, 1};
+	static const TUInt endBand[] = {1, 1, 1, 1, 1, 1};
+	addSymbol(3, 3, startBand);
+	for (TUInt n = 0; n < N_UPCE_DIGITS_; n++)
+		addSymbol(7, 4);
+	addSymbol(6, 6, endBand);
+	LOGD("UPCE Symbology created\n");
+}
+
+UpceSymbology::~UpceSymbology() {}
+
+TUInt UpceSymbology::nPatterns() const
+{
+	return 20;
+}
+
+TUInt UpceSymbology::patternSetSize() const
+{
+	return 20;
+}
+
+int UpceSymbology::darkModuleParity(TUInt i) const
+{
+	return -1;
+}
+
+void UpceSymbology::solveExpandedChecksumPaths(const TMatEnergy &energies, const TUInt *rows, TUInt expansion, TUInt initialState,
+		TEnergy (&pathEnergies)[10][2], TUInt8 (&digits)[N_UPCE_DIGITS_][10])
+{
+	//Unlike UPC-A, a weight may be 0 and the last digit is restricted, so the digits are stored instead of the previous states
+	const TUInt8 *weights = checksumWeights_[expansion];
+	TEnergy prevPathEnergies[10][2];
+	for (TUInt state = 0; state < 10; state++)
+		pathEnergies[state][0] = pathEnergies[state][1] = ski::MaxValue<TEnergy>() / 2;
+	pathEnergies[initialState][0] = 0;
+	for (TUInt t = 0; t < N_UPCE_DIGITS_; t++)
+	{
+		TUInt firstDigit = 0, lastDigit = 9;
+		if (t == N_UPCE_DIGITS_ - 1)
+		{
+			firstDigit = lastDigits_[expansion][0];
+			lastDigit = lastDigits_[expansion][1];
+		}
+		for (TUInt state = 0; state < 10; state++)
+		{
+			prevPathEnergies[state][0] = pathEnergies[state][0];
+			prevPathEnergies[state][1] = pathEnergies[state][1];
+			pathEnergies[state][0] = pathEnergies[state][1] = ski::MaxValue<TEnergy>() / 2;
+			digits[t][state] = 0;
+		}
+		for (TUInt prevState = 0; prevState < 10; prevState++)
+		{
+			const TEnergy *prev = prevPathEnergies[prevState];
+			if (prev[0] >= ski::MaxValue<TEnergy>() / 4)
+				continue;	//not reachable
+			for (TUInt digit = firstDigit; digit <= lastDigit; digit++)
+			{
+				TUInt state = (prevState + weights[t] * digit) % 10;
+				TEnergy digitEnergy = energies(rows[t] + digit, t), energy = prev[0] + digitEnergy;
+				TEnergy *path = pathEnergies[state];
+				if (energy < path[0])
+				{
+					path[1] = min(path[0], prev[1] + digitEnergy);
+					path[0] = energy;
+					digits[t][state] = (TUInt8) digit;
+				}
+				else
+					path[1] = min(path[1], energy);
+			}
+		}
+	}
+}
+
+string UpceSymbology::estimate(const TMatEnergy &energies) const
+{
+	//-----------
+	//Joint estimation of the number system and the check digit, encoded in the parities, with the checksum
+	//-----------
+	if ( (nDataSymbols() != N_UPCE_DIGITS_) || (energies.rows != nPatterns()) )
+		throw logic_error("UpceSymbology: unexpected number of data symbols or patterns");
+	//Lower bound of the energies of the codes with each number system, check digit and expansion,
+	//from the most likely digit of each parity in each symbol
+	static const TUInt N_CODES = 2 * 10 * N_EXPANSIONS_;
+	TEnergy minDigitEnergies[2][N_UPCE_DIGITS_], minLastDigitEnergies[2][N_EXPANSIONS_];
+	for (TUInt parity = 0; parity < 2; parity++)
+	{
+		for (TUInt t = 0; t < N_UPCE_DIGITS_ - 1; t++)
+		{
+			minDigitEnergies[parity][t] = energies(10 * parity, t);
+			for (TUInt digit = 1; digit < 10; digit++)
+				minDigitEnergies[parity][t] = min(minDigitEnergies[parity][t], energies(10 * parity + digit, t));
+		}
+		for (TUInt expansion = 0; expansion < N_EXPANSIONS_; expansion++)
+		{
+			TEnergy &minEnergy = minLastDigitEnergies[parity][expansion];
+			minEnergy = ski::MaxValue<TEnergy>();
+			for (TUInt digit = lastDigits_[expansion][0]; digit <= lastDigits_[expansion][1]; digit++)
+				minEnergy = min(minEnergy, energies(10 * parity + digit, N_UPCE_DIGITS_ - 1));
+		}
+	}
+	std::pair<TEnergy, TUInt> bounds[N_CODES];	//codes are numbered as (10 * number system + check digit) * N_EXPANSIONS_ + expansion
+	for (TUInt code = 0; code < N_CODES; code++)
+	{
+		TUInt numberSystem = code / (10 * N_EXPANSIONS_), checkDigit = (code / N_EXPANSIONS_) % 10, expansion = code % N_EXPANSIONS_;
+		const TUInt *isEven = isEvenParity_[checkDigit];
+		TEnergy bound = minLastDigitEnergies[isEven[N_UPCE_DIGITS_ - 1] ^ numberSystem][expansion];
+		for (TUInt t = 0; t < N_UPCE_DIGITS_ - 1; t++)
+			bound += minDigitEnergies[isEven[t] ^ numberSystem][t];
+		bounds[code] = std::pair<TEnergy, TUInt>(bound, code);
+	}
+	sort(bounds, bounds + N_CODES);
+	//Solve the checksum for each parity pattern and expansion in increasing order of their bounds, until none can beat the second best code.
+	TEnergy bestEnergy = ski::MaxValue<TEnergy>(), secondBestEnergy = ski::MaxValue<TEnergy>();
+	TUInt bestCode = 0, bestDigits[N_UPCE_DIGITS_], patterns[N_UPCE_DIGITS_];
+	for (TUInt i = 0; (i < N_CODES) && (bounds[i].first < secondBestEnergy); i++)
+	{
+		TUInt code = bounds[i].second, rows[N_UPCE_DIGITS_];
+		TUInt numberSystem = code / (10 * N_EXPANSIONS_), checkDigit = (code / N_EXPANSIONS_) % 10, expansion = code % N_EXPANSIONS_;
+		for (TUInt t = 0; t < N_UPCE_DIGITS_; t++)
+			rows[t] = 10 * (isEvenParity_[checkDigit][t] ^ numberSystem);
+		TEnergy pathEnergies[10][2];
+		TUInt8 digits[N_UPCE_DIGITS_][10];
+		solveExpandedChecksumPaths(energies, rows, expansion, (3 * numberSystem) % 10, pathEnergies, digits);
+		//The check digit must complete the checksum to a multiple of 10
+		TUInt state = (10 - checkDigit) % 10;
+		TEnergy energy = pathEnergies[state][0];
+		if (energy < bestEnergy)
+		{
+			secondBestEnergy = min(bestEnergy, pathEnergies[state][1]);
+			bestEnergy = energy;
+			bestCode = code;
+			//Backtrack the digits
+			for (TUInt t = N_UPCE_DIGITS_; t-- > 0; )
+			{
+				bestDigits[t] = digits[t][state];
+				patterns[t] = rows[t] + bestDigits[t];
+				state = (state + 10 - (checksumWeights_[expansion][t] * bestDigits[t]) % 10) % 10;
+			}
+		}
+		else
+			secondBestEnergy = min(secondBestEnergy, energy);
+	}
+	if (bestEnergy >= ski::MaxValue<TEnergy>() / 4)
+		return string();
+	string upceStr(1, (char) ('0' + bestCode / (10 * N_EXPANSIONS_)));
+	for (TUInt t = 0; t < N_UPCE_DIGITS_; t++)
+		upceStr += (char) ('0' + bestDigits[t]);
+	upceStr += (char) ('0' + (bestCode / N_EXPANSIONS_) % 10);
+
+	//-----------
+	//Checks
+	//-----------
+	return (isVerified(energies, patterns, bestEnergy, secondBestEnergy, upceStr) ? upceStr : string());
+}
+
+void UpceSymbology::estimateBatch(const vector<const TMatEnergy*> &energies, BatchViterbi<TEnergy> &batch, vector<string> &estimates) const
+{
+	//The joint estimation is not a single checksum chain, so the barcodes are estimated one at a time
+	BarcodeSymbology::estimateBatch(energies, batch, estimates);
+}
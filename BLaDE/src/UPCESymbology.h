@@ -0,0 +1,121 @@
+/*
+Copyright (c) 2012, The Smith-Kettlewell Eye Research Institute
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the The Smith-Kettlewell Eye Research Institute nor
+      the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE SMITH-KETTLEWELL EYE RESEARCH INSTITUTE BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/**
+ * @file UPCESymbology.h
+ * UPC-E symbology, the zero suppressed form of UPC-A.
+ * @author Ender Tekin
+ */
+
+#ifndef UPCESYMBOLOGY_H_
+#define UPCESYMBOLOGY_H_
+
+#include "UPCASymbology.h"
+
+/**
+ * UPC-E symbology, which encodes a UPC-A code with suppressed zeros in six digits between a start guard band and
+ * a six bar end guard band. The digits are encoded with the UPC-A digit patterns of odd parity or their reverses of
+ * even parity, and the parities encode the number system (0 or 1) and the check digit of the expanded UPC-A code.
+ * As the guard bands differ, the layout is not symmetric.
+ */
+class UpceSymbology: public UpcaSymbology
+{
+public:
+	/**
+	 * Constructor
+	 */
+	UpceSymbology(const Options &opts = Options());
+
+	/**
+	 * Destructor
+	 */
+	virtual ~UpceSymbology();
+
+	/**
+	 * Number of convolution patterns: the ten odd parity digit patterns, followed by the ten even parity digit patterns
+	 */
+	virtual TUInt nPatterns() const;
+
+	/**
+	 * Number of patterns in each set whose energies are normalized together, the odd and even parity digits being separate sets
+	 */
+	virtual TUInt patternSetSize() const;
+
+	/**
+	 * Parity of the number of dark modules in a data symbol.
+	 * @param[in] i index of the data symbol
+	 * @return -1, as the parities depend on the number system and the check digit
+	 */
+	virtual int darkModuleParity(TUInt i) const;
+
+	/**
+	 * Estimates the barcode from the matrix of pattern energies for each symbol
+	 * @param[in] energies matrix of pattern energies per symbol
+	 * @return a string of the number system, the six digits and the check digit, empty string if estimate fails verification
+	 */
+	string estimate(const TMatEnergy &energies) const;
+
+	/**
+	 * Estimates several barcodes, each on its own with estimate()
+	 * @param[in] energies energies[b] is the matrix of pattern energies per symbol of barcode b
+	 * @param[in,out] batch unused
+	 * @param[out] estimates estimates[b] is the estimate of barcode b, empty string if it fails verification
+	 */
+	virtual void estimateBatch(const vector<const TMatEnergy*> &energies, BatchViterbi<TEnergy> &batch, vector<string> &estimates) const;
+
+protected:
+	/** Number of data symbols */
+	static const TUInt N_UPCE_DIGITS_ = 6;
+
+	/** Number of ways the last digit expands the code to UPC-A, each weighting the digits differently in the checksum */
+	static const TUInt N_EXPANSIONS_ = 4;
+
+	/** isEvenParity_[check digit][i] is 1 if the i'th digit is encoded with even parity in number system 0, parities being inverted in number system 1 */
+	static const TUInt isEvenParity_[10][N_UPCE_DIGITS_];
+
+	/** checksumWeights_[expansion][i] is the weight of the i'th digit in the checksum of the expanded UPC-A code */
+	static const TUInt8 checksumWeights_[N_EXPANSIONS_][N_UPCE_DIGITS_];
+
+	/** lastDigits_[expansion] is the range of the last digit that selects the expansion, as [first, last] */
+	static const TUInt lastDigits_[N_EXPANSIONS_][2];
+
+	/**
+	 * Finds the two lowest energy paths into each checksum state over the six digits, starting from a given state.
+	 * @param[in] energies matrix of pattern energies per symbol
+	 * @param[in] rows rows[t] is the row of digit 0 of symbol t in energies, the other digits following it
+	 * @param[in] expansion expansion, which sets the checksum weights and the range of the last digit
+	 * @param[in] initialState checksum state before the first symbol
+	 * @param[out] pathEnergies pathEnergies[state][k] is the energy of the k'th best path into state (mod 10)
+	 * @param[out] digits digits[t][state] is the digit of symbol t on the best path into state at symbol t
+	 */
+	static void solveExpandedChecksumPaths(const TMatEnergy &energies, const TUInt *rows, TUInt expansion, TUInt initialState,
+			TEnergy (&pathEnergies)[10][2], TUInt8 (&digits)[N_UPCE_DIGITS_][10]);
+};
+
+
+#endif /* UPCESYMBOLOGY_H_ */
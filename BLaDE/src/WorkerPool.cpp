@@ -0,0 +1,131 @@
+/*
+Copyright (c) 2012, The Smith-Kettlewell Eye Research Institute
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the The Smith-Kettlewell Eye Research Institute nor
+      the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE SMITH-KETTLEWELL EYE RESEARCH INSTITUTE BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file WorkerPool.cpp
+ * @author Ender Tekin
+ */
+
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(TUInt nWorkers):
+	nWorkers_(nWorkers > 0 ? nWorkers : 1),
+	job_(NULL),
+	nJobs_(0),
+	nextJob_(0),
+	nBusyHelpers_(0),
+	batch_(0),
+	isStopping_(false)
+{
+	threads_.reserve(nWorkers_ - 1);
+	for (TUInt w = 1; w < nWorkers_; w++)
+		threads_.push_back(std::thread(&WorkerPool::helperLoop, this, w));
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		isStopping_ = true;
+	}
+	batchReady_.notify_all();
+	for (std::vector<std::thread>::iterator t = threads_.begin(); t != threads_.end(); t++)
+		t->join();
+}
+
+void WorkerPool::run(TUInt nJobs, const Job &job)
+{
+	if (nJobs == 0)
+		return;
+	if (threads_.empty() || (nJobs == 1))
+	{
+		//Nothing to gain from the helpers
+		for (TUInt n = 0; n < nJobs; n++)
+			job(n, 0);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		job_ = &job;
+		nJobs_ = nJobs;
+		nextJob_ = 0;
+		nBusyHelpers_ = threads_.size();
+		error_ = std::exception_ptr();
+		batch_++;
+	}
+	batchReady_.notify_all();
+	work(0);
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (nBusyHelpers_ > 0)
+		batchDone_.wait(lock);
+	job_ = NULL;
+	if (error_)
+		std::rethrow_exception(error_);
+}
+
+void WorkerPool::helperLoop(TUInt worker)
+{
+	TUInt64 lastBatch = 0;
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true)
+	{
+		while (!isStopping_ && (batch_ == lastBatch))
+			batchReady_.wait(lock);
+		if (isStopping_)
+			return;
+		lastBatch = batch_;
+		lock.unlock();
+		work(worker);
+		lock.lock();
+		if (--nBusyHelpers_ == 0)
+			batchDone_.notify_one();
+	}
+}
+
+void WorkerPool::work(TUInt worker)
+{
+	while (true)
+	{
+		TUInt n;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (nextJob_ >= nJobs_)
+				return;
+			n = nextJob_++;
+		}
+		try
+		{
+			(*job_)(n, worker);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!error_)
+				error_ = std::current_exception();
+		}
+	}
+}
@@ -0,0 +1,134 @@
+/*
+Copyright (c) 2012, The Smith-Kettlewell Eye Research Institute
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the The Smith-Kettlewell Eye Research Institute nor
+      the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE SMITH-KETTLEWELL EYE RESEARCH INSTITUTE BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file WorkerPool.h
+ * Simple pool of worker threads used to run independent jobs in parallel.
+ * @author Ender Tekin
+ */
+
+#ifndef WORKERPOOL_H_
+#define WORKERPOOL_H_
+
+#include "ski/types.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+/**
+ * Pool of worker threads.
+ * A batch of jobs is handed to the pool via run(), which returns once all jobs are finished.
+ * The calling thread takes part in the work as worker 0, so a pool with a single worker runs
+ * everything in the calling thread without any synchronization.
+ */
+class WorkerPool
+{
+public:
+	/**
+	 * A job to run. Called as job(jobIndex, workerIndex), where workerIndex < size() can be used
+	 * to index per-worker scratch areas.
+	 */
+	typedef std::function<void(TUInt, TUInt)> Job;
+
+	/**
+	 * Constructor
+	 * @param[in] nWorkers number of workers, including the calling thread. 0 is treated as 1.
+	 */
+	WorkerPool(TUInt nWorkers);
+
+	/**
+	 * Destructor - waits for the worker threads to exit
+	 */
+	~WorkerPool();
+
+	/**
+	 * Number of workers in this pool
+	 */
+	inline TUInt size() const {return nWorkers_; };
+
+	/**
+	 * Runs a batch of jobs and waits until all of them are finished.
+	 * If any job throws, the first exception is rethrown in the calling thread once the batch is done.
+	 * @param[in] nJobs number of jobs in the batch
+	 * @param[in] job job to run for each index 0..nJobs-1
+	 */
+	void run(TUInt nJobs, const Job &job);
+
+private:
+	/** Number of workers including the calling thread */
+	const TUInt nWorkers_;
+
+	/** Helper threads */
+	std::vector<std::thread> threads_;
+
+	/** Protects the batch state below */
+	std::mutex mutex_;
+
+	/** Signals the helpers that a new batch is available or that the pool is shutting down */
+	std::condition_variable batchReady_;
+
+	/** Signals the calling thread that the helpers are done with the current batch */
+	std::condition_variable batchDone_;
+
+	/** Job of the current batch */
+	const Job *job_;
+
+	/** Number of jobs in the current batch */
+	TUInt nJobs_;
+
+	/** Index of the next job to hand out */
+	TUInt nextJob_;
+
+	/** Number of helpers still working on the current batch */
+	TUInt nBusyHelpers_;
+
+	/** Incremented with each batch so that the helpers can tell batches apart */
+	TUInt64 batch_;
+
+	/** True when the pool is being destroyed */
+	bool isStopping_;
+
+	/** First exception thrown by a job of the current batch */
+	std::exception_ptr error_;
+
+	/**
+	 * Main loop of a helper thread
+	 * @param[in] worker index of this worker
+	 */
+	void helperLoop(TUInt worker);
+
+	/**
+	 * Takes jobs from the current batch until there are none left.
+	 * @param[in] worker index of the worker doing the work
+	 */
+	void work(TUInt worker);
+};
+
+#endif /* WORKERPOOL_H_ */
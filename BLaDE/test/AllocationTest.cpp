@@ -0,0 +1,163 @@
+/*
+Copyright (c) 2012, The Smith-Kettlewell Eye Research Institute
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the The Smith-Kettlewell Eye Research Institute nor
+      the names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE SMITH-KETTLEWELL EYE RESEARCH INSTITUTE BE
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file AllocationTest.cpp
+ * Checks that reading barcodes does not allocate once the decoder is warmed up. This is a separate program rather than
+ * a _LIBTEST function of the library, as it replaces the global operator new and operator delete with counting ones.
+ * It is built by compiling it together with the sources in ../src, with ../../include and ../src on the include path,
+ * and returns 0 if reading did not allocate.
+ */
+
+#include "Decoder.h"
+#include "UPCASymbology.h"
+#include "WorkerPool.h"
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+/** Whether the allocations are counted, while testing that decoding does not allocate */
+static std::atomic<bool> isCountingAllocations(false);
+/** Number of allocations counted */
+static std::atomic<long> nAllocations(0);
+
+void* operator new(std::size_t size)
+{
+	if (isCountingAllocations)
+		nAllocations++;
+	void *p = malloc(size > 0 ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+/**
+ * Draws a UPC-A barcode with bars of the given module width, smoothing the bar edges by supersampling
+ * @param[out] img image to draw in, filled with the background
+ * @param[in] digits the 12 digits of the barcode
+ * @param[in] module module width in pixels
+ * @param[in] angle angle of the barcode
+ * @param[out] bc barcode with the ends of the guard bars, as the locator would find them
+ */
+static void drawUpca(TMatrixUInt8 &img, const char *digits, double module, double angle, Barcode &bc)
+{
+	static const char *leftCodes[10] = {"0001101", "0011001", "0010011", "0111101", "0100011", "0110001", "0101111", "0111011", "0110111", "0001011"};
+	string bits = "101";
+	for (int d = 0; d < 12; d++)
+	{
+		if (d == 6)
+			bits += "01010";
+		for (const char *b = leftCodes[digits[d] - '0']; *b != 0; b++)
+			bits += ( (*b == '1') == (d < 6) ? '1' : '0');	//right digits are the complements of the left ones
+	}
+	bits += "101";
+	const double width = bits.size() * module, height = 0.5 * width, c = cos(angle), s = sin(angle);
+	const TPointDouble center(0.5 * img.cols, 0.5 * img.rows);
+	const int S = 4;
+	for (int y = 0; y < (int) img.rows; y++)
+	{
+		for (int x = 0; x < (int) img.cols; x++)
+		{
+			int sum = 0;
+			for (int sy = 0; sy < S; sy++)
+			{
+				for (int sx = 0; sx < S; sx++)
+				{
+					double dx = x + (sx + 0.5) / S - 0.5 - center.x, dy = y + (sy + 0.5) / S - 0.5 - center.y;
+					double u = dx * c + dy * s + 0.5 * width, v = -dx * s + dy * c;
+					int m = (int) floor(u / module);
+					sum += ( (abs(v) < 0.5 * height) && (m >= 0) && (m < (int) bits.size()) && (bits[m] == '1') ? 30 : 220);
+				}
+			}
+			img(y, x) = (TUInt8) (sum / (S * S));
+		}
+	}
+	bc = Barcode(TPointInt(center.x - 0.5 * width * c, center.y - 0.5 * width * s), TPointInt(center.x + 0.5 * width * c, center.y + 0.5 * width * s));
+}
+
+/**
+ * Counts the allocations made by read() once the decoder has read a few barcodes, both from an image and from shared
+ * slices after matching the signature, on a pool of workers, and prints whether there are none
+ * @return true if the last pass did not allocate
+ */
+bool testAllocationFreeRead()
+{
+	const char *codes[] = {"036000291452", "012345678905", "614141000036", "725272730706", "042100005264"};
+	const int nCodes = 5, nAngles = 3, nPasses = 3;
+	vector<TMatrixUInt8> frames;
+	vector<Barcode> barcodes;
+	for (int c = 0; c < nCodes; c++)
+	{
+		for (int a = 0; a < nAngles; a++)
+		{
+			frames.push_back(TMatrixUInt8(480, 640));
+			barcodes.push_back(Barcode(TPointInt(0, 0), TPointInt(0, 0)));
+			drawUpca(frames.back(), codes[c], 3.0 + 0.5 * a, 0.15 * (a - 1), barcodes.back());
+		}
+	}
+	WorkerPool workers(2);
+	BarcodeDecoder::Options opts;
+	opts.nScanlines = 3;	//more than one scanline, so that the scanlines are processed by the workers
+	BarcodeDecoder decoder(frames.front(), new UpcaSymbology(), opts, &workers);
+	BarcodeDecoder::Slices slices(opts, decoder.width());
+	int nDecoded = 0;
+	long nReadAllocations = 0, nSliceAllocations = 0;
+	for (int pass = 0; pass < nPasses; pass++)
+	{
+		//Only the last pass is counted, once the workspaces have grown to fit the barcodes
+		isCountingAllocations = (pass == nPasses - 1);
+		for (TUInt n = 0; n < frames.size(); n++)
+		{
+			Barcode bc = barcodes[n];
+			nAllocations = 0;
+			nDecoded += (decoder.read(bc, frames[n]) == BarcodeDecoder::DECODING_SUCCESSFUL ? 1 : 0);
+			nReadAllocations += nAllocations;
+			bc = barcodes[n];
+			nAllocations = 0;
+			if ( slices.reset(bc, frames[n]) && (decoder.matchSignature(slices) >= 0) )
+				nDecoded += (decoder.read(bc, slices) == BarcodeDecoder::DECODING_SUCCESSFUL ? 1 : 0);
+			nSliceAllocations += nAllocations;
+		}
+	}
+	isCountingAllocations = false;
+	printf("Allocation free read: %d of %d reads decoded, %ld allocations reading images and %ld reading shared slices in the last pass (%s)\n",
+			nDecoded, 2 * nPasses * (int) frames.size(), nReadAllocations, nSliceAllocations,
+			(nReadAllocations == 0) && (nSliceAllocations == 0) ? "pass" : "FAIL");
+	return (nReadAllocations == 0) && (nSliceAllocations == 0);
+}
+
+int main()
+{
+	return (testAllocationFreeRead() ? 0 : 1);
+}
@@ -101,7 +101,7 @@ bool BarcodeEngine::process()
 	{
 		//Provide audio feedback
 		double sizeScore = calculateSizeScore(bc, input_.size());
-		double alignmentScore = calculateAlignmentScore(bc, input_.size());
+		double alignmentScore = bc.alignmentScore(input_.size());
 		if (isAudioFeedbackOn_)
 		  audioFeedback_->play(sizeScore, alignmentScore);
 	}
@@ -146,28 +146,6 @@ double BarcodeEngine::calculateSizeScore(const Barcode& bc, const TSizeInt& imSi
 	return sizeScore;
 }
 
-double BarcodeEngine::calculateAlignmentScore(const Barcode& bc, 	const TSizeInt& imSize)
-{
-	double w = imSize.width, h = imSize.height;
-	int minDist = std::min(w, h) / 20; //how far the edges should be from the edge of the image
-	int leftDist = std::min(bc.firstEdge.x, bc.lastEdge.x);
-	int rightDist = w - std::max(bc.firstEdge.x, bc.lastEdge.x);
-	int topDist = std::min(bc.firstEdge.y, bc.lastEdge.y);
-	int botDist = h - std::max(bc.firstEdge.y, bc.lastEdge.y);
-	//Now calculate the scores
-	double alignmentScore = 1.0;
-	if (leftDist < minDist)
-		alignmentScore *= .5 * leftDist / minDist + .5;
-	if (rightDist < minDist)
-		alignmentScore *= .5 * rightDist / minDist + .5;
-	if (topDist < minDist)
-		alignmentScore *= .5 * topDist / minDist + .5;
-	if (botDist < minDist)
-		alignmentScore *= .5 * botDist / minDist + .5;
-	return alignmentScore;
-
-}
-
 BarcodeEngine::AudioFeedback::AudioFeedback()
 try :
 	soundParams_(N_CHANNELS, RATE, PERIOD_SIZE, N_PERIODS),
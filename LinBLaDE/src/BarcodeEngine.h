@@ -76,15 +76,6 @@ private:
 	 */
 	static double calculateSizeScore(const Barcode &bc, const TSizeInt& imSize);
 
-	/**
-	 * Calculates the alignment score of a barcode, indicating how happy we are with the barcode's
-	 * alignment in the image frame.
-	 * @param bc detected barcode
-	 * @param imSize size of image barcode is detected in
-	 * @return a score showing indicating how well aligned the barcode is in the image for attempting decoding
-	 */
-	static double calculateAlignmentScore(const Barcode &bc, const TSizeInt& imSize);
-
 	//-----------------------
 	//Visual Feedback
 	//-----------------------
@@ -35,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "ski/types.h"
 #include <memory>
+#include <vector>
 #include "ski/BLaDE/Barcode.h"
 
 //Forward declarations
@@ -56,6 +57,47 @@ public:
 		TUInt scale;
 		/** Minimum number of cells a barcode needs to contain.*/
 		TUInt nOrientations;
+		/**
+		 * Side length in pixels of the square tiles the image is located in. 0 locates on the whole image at once.
+		 * When tiling, the locator only allocates buffers for a tile, so memory use does not grow with the image size.
+		 * This is meant for large stills; a tile size of 256 keeps the per-tile gradient buffers roughly within a typical L2 cache.
+		 */
+		TUInt tileSize;
+		/** Overlap in pixels between neighboring tiles, should be comparable to the height of the barcodes sought */
+		TUInt tileOverlap;
+		/** Number of threads to use, including the calling thread */
+		TUInt nThreads;
+		/**
+		 * Number of consecutive frames over which the digit evidence of a tracked barcode is accumulated, so that a barcode
+		 * that cannot be read confidently from any single frame may still be read from several. 1 disables fusion.
+		 */
+		TUInt nFusedFrames;
+		/** Located barcodes with a sharpness (see Barcode::sharpness) below this are not decoded, as they are too blurry to decode */
+		double minSharpness;
+		/**
+		 * Number of parallel scanlines across the bars that are read and combined when decoding, so that a highlight or
+		 * a smudge on one of them does not spoil the decoding. 1 reads only along the located barcode.
+		 */
+		TUInt nScanlines;
+		/** Distance between neighboring scanlines, as a fraction of the barcode length */
+		double scanlineSpacing;
+		/** Whether to combine the scanlines by the median of their digit energies instead of their sum */
+		bool useScanlineMedian;
+		/** Whether to solve the fixed edge fits of the scanlines, and the estimates of both reading directions, together in batches */
+		bool useBatchViterbi;
+		/**
+		 * Minimum number of data characters of the Code 128 barcodes to read, between the start and the check characters.
+		 * Each length is read by its own decoder, so a wide range slows down failed decoding attempts.
+		 */
+		TUInt minCode128Characters;
+		/** Maximum number of data characters of the Code 128 barcodes to read */
+		TUInt maxCode128Characters;
+		/**
+		 * Number of frames for which a decoded barcode is reported again without decoding it, as long as it is located at
+		 * the same place and the image along it has not changed, as when it sits still in front of a fixed camera.
+		 * The barcode is decoded again once it moves or after this many frames. 0 disables the cache.
+		 */
+		TUInt nCachedFrames;
 		/**
 		 * Constructor
 		 * @param[in] s scale to work at
@@ -63,7 +105,19 @@ public:
 		 */
 		Options(TUInt s=0, TUInt n=18):
 			scale(s),
-			nOrientations(n)
+			nOrientations(n),
+			tileSize(0),
+			tileOverlap(64),
+			nThreads(1),
+			nFusedFrames(1),
+			minSharpness(0),
+			nScanlines(1),
+			scanlineSpacing(0.05),
+			useScanlineMedian(false),
+			useBatchViterbi(false),
+			minCode128Characters(1),
+			maxCode128Characters(12),
+			nCachedFrames(0)
 		{};
 	};
 
@@ -72,16 +126,27 @@ public:
 	 */
 	enum PredefinedSymbology
 	{
-		UPCA = 1
+		UPCA = 1,
+		EAN13 = 2,
+		EAN8 = 3,
+		UPCE = 4,
+		CODE128 = 5
 	};
 
 	/**
-	 * Constructor
+	 * Constructor. Rows cannot be pushed into a read-only image, see pushRows().
 	 * @param[in] aImg input image to work on
 	 * @param[in] opts options to use
 	 */
 	BLaDE(const TMatrixUInt8 &aImg, const Options &opts=Options());
 
+	/**
+	 * Constructor for an image that may also be filled in by pushRows().
+	 * @param[in, out] aImg input image to work on, into which pushRows() copies the rows it is given
+	 * @param[in] opts options to use
+	 */
+	BLaDE(TMatrixUInt8 &aImg, const Options &opts=Options());
+
 	/**
 	 * Destructor
 	 */
@@ -94,25 +159,71 @@ public:
 	BarcodeList& locate();
 
 	/**
-	 * Add symbology to use for decoding. Symbologies are tried in the order they are added.
+	 * Copies the next rows of a frame that arrives row by row into the image associated with this engine.
+	 * Locating work is done on the rows as they arrive, so that only a short amount of work remains for locate()
+	 * once the last row has been pushed. Rows are pushed from the top of the image, and the next frame starts
+	 * after each call to locate(). In tiled mode, the rows are only copied. The engine must have been constructed with
+	 * a writable image, otherwise a logic_error is thrown.
+	 * @param[in] rows pointer to the first pixel of the first row to push
+	 * @param[in] nRows number of rows to push
+	 * @param[in] stride distance in bytes between the starts of consecutive rows in rows
+	 */
+	void pushRows(const TUInt8 *rows, TUInt nRows, TUInt stride);
+
+	/**
+	 * Add symbology to use for decoding. Symbologies whose signature (number of edges, guard patterns and width) matches
+	 * the barcode best are tried first, in the order they are added when they match equally well. Symbologies whose
+	 * number of edges does not fit the edges detected on any scanline are not tried.
 	 * @param[in] aSymbology a symbology to try when attempting to decode
 	 */
 	void addSymbology(BarcodeSymbology* aSymbology);
 
 	/**
 	 * Adds a pre-defined symbology (with default options) to use for decoding.
-	 * Symbologies are tried in the order they are added.
+	 * Symbologies are tried as in addSymbology(BarcodeSymbology*). UPC-A and EAN-13 are read by a single decoder when both are added.
+	 * Code 128 is read by a decoder for each number of characters in the range set by the options.
 	 * @param[in] aSymbology a symbology to try when attempting to decode
 	 */
 	void addSymbology(PredefinedSymbology aSymbology);
 
 	/**
-	 * Attempt to decode a barcode
+	 * Attempt to decode a barcode. If the barcode cache is enabled (see Options::nCachedFrames), a barcode decoded
+	 * in a recent frame that has not moved since is reported again without decoding.
 	 * @param[in, out] bc a located barcode returned by getLocator->locate()
 	 * @return true if one of the symbologies has correctly decoded the barcode
 	 */
 	bool decode(Barcode &bc);
 
+	/**
+	 * Decodes a barcode from a burst of frames, such as those captured in quick succession by a handheld camera.
+	 * Barcodes are located in every frame, and decoding is attempted on the candidates from all frames in the order
+	 * of their quality (sharpness, edge density and how well they are framed), stopping at the first success.
+	 * The frames must be the same size as the image associated with this engine, and are not tiled.
+	 * @param[in] frames frames of the burst
+	 * @param[out] bc decoded barcode, if any
+	 * @param[out] nFramesExamined number of frames whose candidates were tried for decoding
+	 * @return true if a barcode has been decoded
+	 */
+	bool decodeBurst(const std::vector<TMatrixUInt8> &frames, Barcode &bc, TUInt &nFramesExamined);
+
+	/**
+	 * Decodes all the barcodes located in the image associated with this engine, such as the barcodes on a shelf.
+	 * Unlike decode(), the barcodes are decoded whatever their size and position in the frame.
+	 * Candidates that overlap or continue each other along the same line are merged first, and the remaining
+	 * candidates are decoded concurrently on the worker threads (see Options::nThreads).
+	 * @param[in, out] barcodes barcodes returned by locate(). On return, holds the barcodes decoded, in the same order,
+	 * the later ones of those decoded with the same estimate and symbology being removed.
+	 * @return number of barcodes decoded
+	 */
+	TUInt decodeAll(BarcodeList &barcodes);
+
+	/**
+	 * Sharpness of the last located frame, as the mean gradient magnitude of the pixels in barcode-like regions.
+	 * Can be used to pick the sharpest of several frames. In tiled mode, this is the sharpness of the sharpest tile.
+	 * @return sharpness of the last located frame, 0 if no barcode-like regions were found
+	 */
+	double sharpness() const;
+
 private:
 	std::unique_ptr<_BLaDE> blade_;
 };
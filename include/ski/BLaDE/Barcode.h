@@ -38,6 +38,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "ski/cv.hpp"
 #include <string>
 #include <list>
+#include <algorithm>
 
 /**
  * Structure containing information about decoded barcode.
@@ -56,6 +57,18 @@ struct Barcode
 	/** Type of barcode (determined by the decoder that produces a valid estimate) */
 	std::string symbology;
 
+	/**
+	 * Sharpness of the edges along this barcode segment, as the mean edge gradient magnitude relative to the contrast.
+	 * About 1 for ideal step edges, decreasing with blur. Negative if unknown, e.g. for barcodes not produced by the locator.
+	 */
+	double sharpness;
+
+	/** Difference between the brightest and darkest intensities along this barcode segment, 0 if unknown */
+	double contrast;
+
+	/** Number of correctly oriented edge pixels per pixel along this barcode segment, 0 if unknown */
+	double edgeDensity;
+
 	/**
 	 * Constructor
 	 * @param[in] pt1 one end of the barcode strip
@@ -65,8 +78,36 @@ struct Barcode
 	 */
 	Barcode(const TPointInt &pt1, const TPointInt &pt2) :
 		firstEdge(pt1),
-		lastEdge(pt2)
+		lastEdge(pt2),
+		sharpness(-1),
+		contrast(0),
+		edgeDensity(0)
 	{};
+
+	/**
+	 * Scores how well this barcode is framed, penalizing barcodes whose ends are close to the image borders.
+	 * @param[in] imSize size of the image the barcode was located in
+	 * @return alignment score between 0 and 1
+	 */
+	double alignmentScore(const TSizeInt &imSize) const
+	{
+		int w = imSize.width, h = imSize.height;
+		int minDist = std::min(w, h) / 20; //how far the edges should be from the edge of the image
+		int leftDist = std::min(firstEdge.x, lastEdge.x);
+		int rightDist = w - std::max(firstEdge.x, lastEdge.x);
+		int topDist = std::min(firstEdge.y, lastEdge.y);
+		int botDist = h - std::max(firstEdge.y, lastEdge.y);
+		double score = 1.0;
+		if (leftDist < minDist)
+			score *= .5 * leftDist / minDist + .5;
+		if (rightDist < minDist)
+			score *= .5 * rightDist / minDist + .5;
+		if (topDist < minDist)
+			score *= .5 * topDist / minDist + .5;
+		if (botDist < minDist)
+			score *= .5 * botDist / minDist + .5;
+		return score;
+	};
 };
 
 typedef std::list<Barcode> BarcodeList;
@@ -37,6 +37,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <list>
 #include "ski/cv.hpp"
+#include "ski/viterbi.h"
 
 /** Matrix to store digit energies, energies_(digit, symbol)*/
 typedef double TEnergy;
@@ -148,6 +149,76 @@ public:
 		inline bool isDataSymbol() const {return (index != -1); };
 	};
 
+	/**
+	 * Cheap description of a layout, which the edges detected on a scanline can be compared with before decoding
+	 */
+	struct Signature
+	{
+		/** Number of edges of the layout, see nTotalEdges() */
+		TUInt nEdges;
+
+		/** Width of the layout in fundamental widths, see width() */
+		TUInt width;
+
+		/** Widths of the bars of the special symbol at the start of the layout, empty if it starts with a data symbol */
+		vector<TUInt> startGuard;
+
+		/** Widths of the bars of the special symbol at the end of the layout, empty if it ends with a data symbol */
+		vector<TUInt> endGuard;
+	};
+
+	/**
+	 * Flat description of a layout, holding in contiguous arrays what is needed of the fixed edges and the data symbols
+	 * to fit the layout, so that they are accessed by index rather than through the lists of edges, bars and symbols
+	 */
+	struct FlatLayout
+	{
+		/** Name of the symbology */
+		const char *name;
+
+		/** Number of edges of the layout, see nTotalEdges() */
+		TUInt nTotalEdges;
+
+		/** Width of the layout in fundamental widths, see width() */
+		TUInt width;
+
+		/** Indices of the fixed edges among all the edges of the layout */
+		vector<int> fixedEdgeIndices;
+
+		/** Locations of the fixed edges in fundamental widths */
+		vector<int> fixedEdgeLocations;
+
+		/** Polarities of the fixed edges, see Edge::polarity() */
+		vector<int> fixedEdgePolarities;
+
+		/** Widths of the data symbols in fundamental widths */
+		vector<TUInt> symbolWidths;
+
+		/** Indices among the fixed edges of the left edge of each data symbol */
+		vector<TUInt> symbolLeftFixedEdges;
+
+		/** Indices among the fixed edges of the right edge of each data symbol */
+		vector<TUInt> symbolRightFixedEdges;
+
+		/** Number of fixed edges */
+		inline TUInt nFixedEdges() const {return fixedEdgeLocations.size(); };
+
+		/** Number of data symbols */
+		inline TUInt nDataSymbols() const {return symbolWidths.size(); };
+
+		/** Number of positive edges before fixed edge n, see Edge::nPreviousPositiveEdges() */
+		inline int nPreviousPositiveEdges(TUInt n) const {return fixedEdgeIndices[n] >> 1; };
+
+		/** Number of negative edges before fixed edge n, see Edge::nPreviousNegativeEdges() */
+		inline int nPreviousNegativeEdges(TUInt n) const {return (fixedEdgeIndices[n] + 1) >> 1; };
+
+		/** Number of bars of data symbol s */
+		inline TUInt nSymbolBars(TUInt s) const {return fixedEdgeIndices[symbolRightFixedEdges[s]] - fixedEdgeIndices[symbolLeftFixedEdges[s]]; };
+
+		/** Whether bar b of data symbol s is dark */
+		inline bool isSymbolBarDark(TUInt s, TUInt b) const {return ((fixedEdgeIndices[symbolLeftFixedEdges[s]] + b) % 2 == 0); };
+	};
+
 	/**
 	 * Constructor
 	 * @param[in] name of symbology
@@ -201,18 +272,69 @@ public:
 	inline TUInt width() const {return edges_.back().location; };
 
 	/**
-	 * Will return a convolution pattern for the particular symbology. Must be overwritten by the derived symbology
+	 * Number of convolution patterns, i.e. of rows of the energy matrix. Defaults to the ten digits.
+	 */
+	virtual TUInt nPatterns() const;
+
+	/**
+	 * Number of patterns in each set of consecutive patterns whose energies are normalized together.
+	 * Sets hold alternative encodings of the same values, such as the odd and even parity digits of EAN-13.
+	 * Defaults to nPatterns().
+	 */
+	virtual TUInt patternSetSize() const;
+
+	/**
+	 * Number of patterns a data symbol may take, which are the first ones and a whole number of pattern sets.
+	 * The energies of the other patterns are neither calculated nor used. Defaults to nPatterns().
+	 * @param[in] i index of the data symbol
+	 */
+	virtual TUInt nSymbolPatterns(TUInt i) const;
+
+	/**
+	 * Will return a convolution pattern for the particular symbology. Must be overwritten by the derived symbology.
+	 * The pattern holds the fractional positions of the bar edges relative to a point one fundamental width before the symbol.
+	 * The decoder only requests the patterns of a fundamental width of 1 in both directions, once when it is constructed.
+	 * The default implementation falls back to the integral overload below, so symbologies that only override that one keep working.
+	 */
+	virtual void getConvolutionPattern(TUInt digit, double x, bool isFlipped, vector<double> &pattern) const;
+
+	/**
+	 * Integral convolution pattern, with the bar edges truncated to whole positions.
+	 * @deprecated Override the vector<double> overload instead. The decoder only calls this one through its default implementation.
 	 */
 	virtual void getConvolutionPattern(TUInt digit, double x, bool isFlipped, vector<TUInt> &pattern) const;
 
+	/**
+	 * Parity of the number of dark modules in a data symbol, which can tell the reading direction apart before decoding.
+	 * @param[in] i index of the data symbol
+	 * @return 1 if the number of dark modules is always odd, 0 if it is always even, -1 if it depends on the digit
+	 */
+	virtual int darkModuleParity(TUInt i) const;
+
 	/**
 	 * Final joint decoding of the barcode from digit energies.
 	 * This method must be overwritten by the specific symbologies.
-	 * @param[in] energy matrix, where energies[s,d] corresponds to the energy of the s'th symbol being digit d
+	 * @param[in] energy matrix, where energies(d,s) corresponds to the energy of the s'th symbol taking pattern d
 	 * @return  a string that is the barcode estimate, empty string if no verified estimate is made
 	 */
 	virtual string estimate(const TMatEnergy &energies) const = 0;
 
+	/**
+	 * Decodes several barcodes at once, such as the same barcode read in both directions, so that symbologies whose joint
+	 * decoding is a Viterbi can solve them together. Defaults to calling estimate() on each.
+	 * @param[in] energies energies[b] is the energy matrix of barcode b, as in estimate()
+	 * @param[in,out] batch workspace of two paths to solve the barcodes in, owned by the caller as the symbology may be shared by concurrent decoders
+	 * @param[out] estimates estimates[b] is the estimate of barcode b, empty string if no verified estimate is made
+	 */
+	virtual void estimateBatch(const vector<const TMatEnergy*> &energies, BatchViterbi<TEnergy> &batch, vector<string> &estimates) const;
+
+	/**
+	 * Name of the symbology an estimate belongs to, for symbologies that also read the codes of another symbology.
+	 * @param[in] anEstimate estimate returned by estimate()
+	 * @return name of the symbology of the estimate, name() by default
+	 */
+	virtual const char* estimateName(const string &anEstimate) const;
+
 	/**
 	 * Convert estimated symbols to a string
 	 * @param[in] aEstimate estimate of most likely symbols from given symbol energies,
@@ -221,6 +343,32 @@ public:
 	 */
 	virtual string convertEstimateToString(const vector<TUInt> &aEstimate) const;
 
+	/**
+	 * Signature of the layout
+	 * @return the number of edges, width and guard patterns of the layout
+	 */
+	Signature signature() const;
+
+	/**
+	 * Flat description of the layout, to be built once rather than for every barcode read
+	 * @return the fixed edges and data symbols of the layout in contiguous arrays
+	 */
+	FlatLayout flatLayout() const;
+
+	/**
+	 * Whether the layout reads the same in both directions, in which case the fixed edges found in one direction
+	 * also locate the symbols read in the other direction.
+	 */
+	bool isSymmetric() const;
+
+	/**
+	 * Creates the layout of this symbology read backwards, whose edges are mirrored and whose data symbols are in
+	 * reverse order. The mirrored layout is only meant for localizing the fixed edges of asymmetric symbologies,
+	 * and cannot estimate barcodes.
+	 * @return a new symbology owned by the caller
+	 */
+	BarcodeSymbology* createMirroredLayout() const;
+
 protected:
 	//Symbology name
 	const char *name_;
@@ -255,6 +403,12 @@ protected:
 	 */
 	Symbol* addSymbol(TUInt width, TUInt nBars, const TUInt *pattern=NULL);
 
+	/**
+	 * Adds the symbols of another symbology in reverse order, with the bars of the special symbols reversed
+	 * @param[in] original symbology to mirror
+	 */
+	void addMirroredSymbols(const BarcodeSymbology &original);
+
 private:
 	/**
 	 * Adds a bar to the barcode bar representation
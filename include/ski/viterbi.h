@@ -61,6 +61,10 @@ public:
 	 * Return type for Viterbi - holds the energy and path of a sequence.
 	 */
 	typedef vector<T> TArray_;
+	/** Range [first, second) of the states at one time that may precede a given state at the next time */
+	typedef std::pair<int, int> TRange_;
+	/** Ranges of the possible preceding states for each state at a given time */
+	typedef vector<TRange_> TBand_;
 #if CAN_USE_TEMPLATE_ALIAS
 	typedef ski::TMat<T> TMatrix_;
 #elif defined USE_OPENCV //TODO: once template aliases are implemented (gcc4.7+), use template aliases in cv.hpp instead
@@ -136,8 +140,10 @@ public:
 
 	struct Variable
 	{
-		/** States of this variable */
+		/** States of this variable. Only the first nStates are in use, the rest are kept to be reused without allocations. */
 		vector<State> states;
+		/** Number of states of this variable */
+		int nStates;
 		/**
 		 * Constructor
 		 * @param[in] t index of this variable
@@ -150,11 +156,17 @@ public:
 		int index;
 		/** Number of paths to track for each state */
 		int nPaths;
+		/** Scratch space holding all the paths into a state, kept per variable so that separate Viterbis can run concurrently */
+		vector<SubState> allPaths;
 		/**
 		 * Resizes the variable to have n states
 		 * @param[in] n number of states the variable can have
 		 */
 		void resize(int n);
+		/** End of the states in use */
+		inline typename vector<State>::iterator statesEnd() {return states.begin() + nStates; };
+		/** End of the states in use */
+		inline typename vector<State>::const_iterator statesEnd() const {return states.begin() + nStates; };
 		/**
 		 * Calculates the state energies from the prior
 		 */
@@ -164,8 +176,10 @@ public:
 		 * @param[in] prevVar previous variable
 		 * @param[in] prior prior energies
 		 * @param[in] conditional conditional energies
+		 * @param[in] band if not NULL, (*band)[n] is the range of the states of prevVar that may precede state n.
+		 * Only the conditionals within the band are read.
 		 */
-		void calculate(const Variable &prevVar, const TArray_ prior, const TMatrix_ conditional);
+		void calculate(const Variable &prevVar, const TArray_ &prior, const TMatrix_ &conditional, const TBand_ *band=NULL);
 		/**
 		 * Finds the best nPaths substates and returns references to them.
 		 * @param[out] beststates references to the best substates
@@ -178,9 +192,11 @@ public:
 	 * @param[in] sE singleton energies.  sE[t](i) is the energy of state i at time t.
 	 * @param[in] pE pairwise energies.  pE[t](i,j) is the energy to move from state i at time t to state j at time t+1.
 	 * @param[in] nPaths number of paths to return.
-	 *
+	 * @param[in] bands if not NULL, bands[t][j] is the range of states at time t that may precede state j at time t+1,
+	 * and pE[t](i,j) is only used within these ranges, so that sparse transitions cost time proportional to the band sizes.
+	 * States without any possible preceding states are unreachable and get the maximum energy.
 	 */
-    Viterbi(const vector<TArray_> &sE, const vector<TMatrix_> &pE, int nPaths=1);
+    Viterbi(const vector<TArray_> &sE, const vector<TMatrix_> &pE, int nPaths=1, const vector<TBand_> *bands=NULL);
 
 	/**
 	 * Destructor
@@ -219,6 +235,8 @@ private:
 	const vector<TArray_> &priors_;
 	/** Reference to the pairwise energies.  conditionals_[t](i,j) is the conditional energy from i to j at time t */
 	const vector<TMatrix_> &conditionals_;
+	/** Pointer to the bands of the possible transitions, NULL if all transitions are possible */
+	const vector<TBand_> *bands_;
 	/** sequence length */
     int time_;
 	/** number of paths to track */
@@ -226,6 +244,9 @@ private:
 
 	/**States*/
 	vector<Variable> vars_;
+
+	/** Scratch space for the final states to backtrack from */
+	vector<SubState> finalStates_;
 };
 
 //==================
@@ -266,20 +287,20 @@ Viterbi<T>::State::State(int i, int n/*=1*/):
 //===================
 template <typename T>
 Viterbi<T>::Variable::Variable(int t, int p):
+	nStates(0),
 	index(t),
 	nPaths(p)
 {
 }
 
 template <typename T>
-void Viterbi<T>::Variable::resize(int nStates)
+void Viterbi<T>::Variable::resize(int n)
 {
-	//Add states if necessary
-	states.reserve(nStates);
-	for (int n = states.size(); n < nStates; n++)
-		states.push_back(State(n, nPaths));
-	//trim states if too many
-	states.erase(states.begin() + nStates, states.end());
+	//Add states if necessary, keeping any extra states for later use
+	states.reserve(n);
+	for (int i = states.size(); i < n; i++)
+		states.push_back(State(i, nPaths));
+	nStates = n;
 }
 
 template <typename T>
@@ -287,7 +308,7 @@ void Viterbi<T>::Variable::calculate(const TArray_ &prior)
 {
 	resize(prior.size());
 	typename vector<T>::const_iterator p = prior.begin();
-	for (typename vector<State>::iterator s = states.begin(); s != states.end(); s++, p++)
+	for (typename vector<State>::iterator s = states.begin(); s != statesEnd(); s++, p++)
 	{
 		int path = 0;
 		for (typename vector<SubState>::iterator ss = s->substates.begin(); ss!= s->substates.end(); ss++)
@@ -299,23 +320,42 @@ void Viterbi<T>::Variable::calculate(const TArray_ &prior)
 }
 
 template <typename T>
-void Viterbi<T>::Variable::calculate(const Variable &prevVar, const TArray_ prior, const TMatrix_ conditional)
+void Viterbi<T>::Variable::calculate(const Variable &prevVar, const TArray_ &prior, const TMatrix_ &conditional, const TBand_ *band/*=NULL*/)
 {
-	if (prior.size() != states.size())
+	if ((int) prior.size() != nStates)
 		resize(prior.size());
-	if ( (conditional.rows != (int) prevVar.states.size()) || (conditional.cols != (int) states.size()) )
+	if ( ((int) conditional.rows != prevVar.nStates) || ((int) conditional.cols != nStates) )
 		throw logic_error("Viterbi::Variable: Size mismatch.");
 	//For each state, calculate the min energy paths
-	static vector<SubState> allPaths;
-	int nAllPaths = prevVar.states.size() * prevVar.nPaths;
+	int nAllPaths = prevVar.nStates * prevVar.nPaths;
 	allPaths.resize(nAllPaths, SubState(0));
 	int n = 0;
-	for (typename vector<State>::iterator s = states.begin(); s != states.end(); s++, n++)
+	for (typename vector<State>::iterator s = states.begin(); s != statesEnd(); s++, n++)
 	{
+		int pN = 0, pNEnd = prevVar.nStates;	//range of previous states
+		if (band != NULL)
+		{
+			pN = (*band)[n].first;
+			pNEnd = (*band)[n].second;
+			if ( (pN < 0) || (pNEnd > prevVar.nStates) )
+				throw logic_error("Viterbi::Variable: Band out of range.");
+		}
+		if (pN >= pNEnd)
+		{
+			//Unreachable state, point to an arbitrary previous state so that it can still be backtracked
+			int i = 0;
+			for (typename vector<SubState>::iterator ss = s->substates.begin(); ss != s->substates.end(); ss++)
+			{
+				ss->energy = ski::MaxValue<T>() / 2;
+				ss->index = n;
+				ss->path = i++;
+				ss->prevState = &(prevVar.states.front().substates.front());
+			}
+			continue;
+		}
 		T statePriorEnergy = prior[n];
 		typename vector<SubState>::iterator p = allPaths.begin();
-		int pN = 0;	//index of previous state
-		for (typename vector<State>::const_iterator pS = prevVar.states.begin(); pS != prevVar.states.end(); pS++, pN++)
+		for (typename vector<State>::const_iterator pS = prevVar.states.begin() + pN; pN < pNEnd; pS++, pN++)
 		{
 			T stateTotalEnergy = statePriorEnergy + conditional(pN, n);
 			for (typename vector<SubState>::const_iterator pSS = pS->substates.begin(); pSS != pS->substates.end(); pSS++, p++)
@@ -324,7 +364,7 @@ void Viterbi<T>::Variable::calculate(const Variable &prevVar, const TArray_ prio
 				p->energy = stateTotalEnergy + pSS->energy;
 			}
 		}
-		partial_sort_copy(allPaths.begin(), allPaths.end(), s->substates.begin(), s->substates.end());
+		partial_sort_copy(allPaths.begin(), p, s->substates.begin(), s->substates.end());
 		//Fix path numbers
 		int i = 0;
 		for (typename vector<SubState>::iterator ss = s->substates.begin(); ss != s->substates.end(); ss++)
@@ -339,10 +379,10 @@ template <typename T>
 void Viterbi<T>::Variable::bestStates(vector<SubState> &beststates)
 {
 	//For each state, calculate the min energy paths
-	int nAllStates= states.size() * nPaths;
+	int nAllStates= nStates * nPaths;
 	beststates.clear();
 	beststates.reserve(nAllStates);
-	for (typename vector<State>::iterator s = states.begin(); s != states.end(); s++)
+	for (typename vector<State>::iterator s = states.begin(); s != statesEnd(); s++)
 	{
 		for (typename vector<SubState>::iterator ss = s->substates.begin(); ss != s->substates.end(); ss++)
 			beststates.push_back(*ss);
@@ -356,10 +396,11 @@ void Viterbi<T>::Variable::bestStates(vector<SubState> &beststates)
 //===================
 
 template <typename T>
-Viterbi<T>::Viterbi(const vector<TArray_ > &priorMat, const vector<TMatrix_> &condMat, int nPaths/*=1*/):
+Viterbi<T>::Viterbi(const vector<TArray_ > &priorMat, const vector<TMatrix_> &condMat, int nPaths/*=1*/, const vector<TBand_> *bands/*=NULL*/):
 	solutions(nPaths),
 	priors_(priorMat),
 	conditionals_(condMat),
+	bands_(bands),
 	nPaths_(nPaths)
 {
 }
@@ -379,7 +420,7 @@ void Viterbi<T>::initialize()
 	*/
 	time_ = priors_.size();
 	//Check lengths:
-	if ((int) conditionals_.size() != time_-1)
+	if ( ((int) conditionals_.size() != time_-1) || ( (bands_ != NULL) && ((int) bands_->size() != time_-1) ) )
 		throw logic_error("Viterbi: Time inconsistency!");
 	//Check that the matrices are compatible
 	for (int t = 1; t < time_; t++)
@@ -387,6 +428,8 @@ void Viterbi<T>::initialize()
 		if ( (conditionals_[t-1].rows != priors_[t-1].size())
 				|| (conditionals_[t-1].cols != priors_[t].size()) )
 			throw logic_error("Viterbi: Sizes of the provided matrices are not consistent!");
+		if ( (bands_ != NULL) && ((*bands_)[t-1].size() != priors_[t].size()) )
+			throw logic_error("Viterbi: Sizes of the provided bands are not consistent!");
 	}
 	//Add states if need be
 	vars_.reserve(time_);
@@ -429,7 +472,7 @@ void Viterbi<T>::run()
 {
 	vars_[0].calculate(priors_[0]);
 	for (int t = 1; t < time_; t++)
-		vars_[t].calculate(vars_[t-1], priors_[t], conditionals_[t-1]);
+		vars_[t].calculate(vars_[t-1], priors_[t], conditionals_[t-1], (bands_ != NULL ? &(*bands_)[t-1] : NULL));
 }
 
 template <typename T>
@@ -437,15 +480,14 @@ void Viterbi<T>::backtrack(int finalState)
 {
 	//Backtracks from the final state given in argument
 	Variable &lastVar = vars_[time_-1];
-	vector<SubState> finalStates;
 	const SubState *aState;
 	if (finalState == -1)
-		lastVar.bestStates(finalStates);
+		lastVar.bestStates(finalStates_);
 	else
-		finalStates.assign(lastVar.states[finalState].substates.begin(), lastVar.states[finalState].substates.end());
+		finalStates_.assign(lastVar.states[finalState].substates.begin(), lastVar.states[finalState].substates.end());
 	for (int n = 0; n < nPaths_; n++)
 	{
-		aState = &finalStates[n];
+		aState = &finalStates_[n];
 		solutions[n].energy = aState->energy;
 		for (int t = time_-1; t >= 0; t--)
 		{
@@ -455,7 +497,738 @@ void Viterbi<T>::backtrack(int finalState)
 	}
 }
 
+//=================================
+//Implements the Viterbi algorithm with flat arrays
+//=================================
+/**
+ * Minimum energy Viterbi path detection with the same interface as Viterbi, but storing the path energies and
+ * back pointers in flat arrays indexed by (time, state, path) instead of linked substates.
+ * The k best paths into each state are merged from the sorted paths of the previous states in O(k log k)
+ * after selecting the k best first paths, and all storage is kept between calls to solve().
+ */
+template <typename T=double>
+class FlatViterbi
+{
+public:
+	typedef typename Viterbi<T>::TArray_ TArray_;
+	typedef typename Viterbi<T>::TRange_ TRange_;
+	typedef typename Viterbi<T>::TBand_ TBand_;
+	typedef typename Viterbi<T>::TMatrix_ TMatrix_;
+	typedef typename Viterbi<T>::Solution Solution;
+
+	/**
+	 * Constructor
+	 * @param[in] sE singleton energies.  sE[t](i) is the energy of state i at time t.
+	 * @param[in] pE pairwise energies.  pE[t](i,j) is the energy to move from state i at time t to state j at time t+1.
+	 * @param[in] nPaths number of paths to return.
+	 * @param[in] bands if not NULL, bands[t][j] is the range of states at time t that may precede state j at time t+1,
+	 * as in Viterbi.
+	 */
+	FlatViterbi(const vector<TArray_> &sE, const vector<TMatrix_> &pE, int nPaths=1, const vector<TBand_> *bands=NULL);
+
+	/**
+	 * Solves the Viterbi algorithm.
+	 * @param[in] finalState index of the final state to end. By default, just finds the best state.
+	 * If given a valid index, backtracks from that specific state.
+	 */
+	void solve(int finalState=-1);
+
+	/** Holds the solutions to the Viterbi, sorted in order of increasing energy*/
+	vector<Solution> solutions;
+private:
+	/** A path into a state, made of a path into a previous state and the transition from it */
+	struct Candidate
+	{
+		/** total energy of the path */
+		T energy;
+		/** prior and conditional energy of the transition */
+		T transition;
+		/** index of the previous state */
+		int prevState;
+		/** index of the path into the previous state */
+		int prevPath;
+		/** Constructor */
+		Candidate(T e=((T) 0), T tr=((T) 0), int pS=0, int pP=0): energy(e), transition(tr), prevState(pS), prevPath(pP) {};
+		/** For the max-heap of the best candidates found so far */
+		inline bool operator< (const Candidate &aCandidate) const {return energy < aCandidate.energy; };
+	};
+
+	/** Ordering for the min-heap of candidates to merge */
+	struct IsWorse
+	{
+		inline bool operator() (const Candidate &aCandidate, const Candidate &anotherCandidate) const {return aCandidate.energy > anotherCandidate.energy; };
+	};
+
+	/**
+	 * Checks the consistency of the inputs and sizes the flat arrays
+	 */
+	void initialize();
+
+	/**
+	 * Runs the algorithm
+	 */
+	void run();
+
+	/**
+	 * Finds the nPaths_ best paths into a state from the paths into the previous states
+	 * @param[in] t time of the state
+	 * @param[in] n index of the state
+	 * @param[in] pN first previous state that may precede this state
+	 * @param[in] pNEnd one past the last previous state that may precede this state
+	 */
+	void merge(int t, int n, int pN, int pNEnd);
+
+	/**
+	 * backtracks from pseudostate finalState
+	 * @param[in] finalState final state to backtrack from
+	 */
+	void backtrack(int finalState);
+
+	/** Reference to the singleton energies.  [t](i) is the prior energy of state i at time t */
+	const vector<TArray_> &priors_;
+	/** Reference to the pairwise energies.  conditionals_[t](i,j) is the conditional energy from i to j at time t */
+	const vector<TMatrix_> &conditionals_;
+	/** Pointer to the bands of the possible transitions, NULL if all transitions are possible */
+	const vector<TBand_> *bands_;
+	/** sequence length */
+	int time_;
+	/** number of paths to track */
+	int nPaths_;
+	/** The paths into state n at time t are at offsets_[t] + n * nPaths_ in energies_ and backPointers_ */
+	vector<int> offsets_;
+	/** Energies of the paths into each state, in increasing order */
+	vector<T> energies_;
+	/** Path into the previous state that each path comes from, as prevState * nPaths_ + prevPath */
+	vector<int> backPointers_;
+	/** Scratch space for the candidate paths into a state */
+	vector<Candidate> candidates_;
+	/** Scratch space for the final paths to backtrack from, as (energy, state * nPaths_ + path) */
+	vector<std::pair<T, int> > finalPaths_;
+};
+
+template <typename T>
+FlatViterbi<T>::FlatViterbi(const vector<TArray_ > &priorMat, const vector<TMatrix_> &condMat, int nPaths/*=1*/, const vector<TBand_> *bands/*=NULL*/):
+	solutions(nPaths),
+	priors_(priorMat),
+	conditionals_(condMat),
+	bands_(bands),
+	time_(0),
+	nPaths_(nPaths)
+{
+	if (nPaths_ < 1)
+		throw invalid_argument("FlatViterbi: There must be at least one path.");
+}
+
+template <typename T>
+void FlatViterbi<T>::initialize()
+{
+	time_ = priors_.size();
+	//Check lengths:
+	if ( ((int) conditionals_.size() != time_-1) || ( (bands_ != NULL) && ((int) bands_->size() != time_-1) ) )
+		throw logic_error("FlatViterbi: Time inconsistency!");
+	//Check that the matrices are compatible
+	for (int t = 1; t < time_; t++)
+	{
+		if ( (conditionals_[t-1].rows != priors_[t-1].size())
+				|| (conditionals_[t-1].cols != priors_[t].size()) )
+			throw logic_error("FlatViterbi: Sizes of the provided matrices are not consistent!");
+		if ( (bands_ != NULL) && ((*bands_)[t-1].size() != priors_[t].size()) )
+			throw logic_error("FlatViterbi: Sizes of the provided bands are not consistent!");
+	}
+	//Lay out the paths of all times one after the other, only ever growing the storage
+	offsets_.resize(time_ + 1);
+	offsets_[0] = 0;
+	for (int t = 0; t < time_; t++)
+		offsets_[t + 1] = offsets_[t] + priors_[t].size() * nPaths_;
+	if ((int) energies_.size() < offsets_[time_])
+	{
+		energies_.resize(offsets_[time_]);
+		backPointers_.resize(offsets_[time_]);
+	}
+	/** Initialize solutions */
+	for (typename vector<Solution>::iterator s = solutions.begin(); s!= solutions.end(); s++)
+	{
+		s->energy = (T) 0;
+		s->sequence.resize(time_);
+	}
+}
+
+template <typename T>
+void FlatViterbi<T>::solve(int finalState/*=-1*/)
+{
+	//Ensure finalState is valid:
+	if ( (finalState >= (int) priors_.back().size()) || (finalState < -1) )
+		throw invalid_argument("FlatViterbi: Final state not valid.");
+	initialize();
+	run();
+	backtrack(finalState);
+}
+
+template <typename T>
+void FlatViterbi<T>::run()
+{
+	//The first path into each state is its prior, the others are not possible
+	T *e = &energies_[0];
+	for (typename TArray_::const_iterator p = priors_[0].begin(); p != priors_[0].end(); p++)
+	{
+		*(e++) = *p;
+		for (int k = 1; k < nPaths_; k++)
+			*(e++) = ski::MaxValue<T>() / 2;
+	}
+	for (int t = 1; t < time_; t++)
+	{
+		int nPrevStates = priors_[t-1].size(), nStates = priors_[t].size();
+		for (int n = 0; n < nStates; n++)
+		{
+			int pN = 0, pNEnd = nPrevStates;	//range of previous states
+			if (bands_ != NULL)
+			{
+				pN = (*bands_)[t-1][n].first;
+				pNEnd = (*bands_)[t-1][n].second;
+				if ( (pN < 0) || (pNEnd > nPrevStates) )
+					throw logic_error("FlatViterbi: Band out of range.");
+			}
+			merge(t, n, pN, pNEnd);
+		}
+	}
+}
+
+template <typename T>
+void FlatViterbi<T>::merge(int t, int n, int pN, int pNEnd)
+{
+	T *e = &energies_[offsets_[t] + n * nPaths_];
+	int *b = &backPointers_[offsets_[t] + n * nPaths_];
+	if (pN >= pNEnd)
+	{
+		//Unreachable state, point to an arbitrary previous state so that it can still be backtracked
+		for (int k = 0; k < nPaths_; k++)
+		{
+			e[k] = ski::MaxValue<T>() / 2;
+			b[k] = 0;
+		}
+		return;
+	}
+	const T prior = priors_[t][n];
+	const TMatrix_ &conditional = conditionals_[t-1];
+	const T *prevEnergies = &energies_[offsets_[t-1]];
+	if (nPaths_ == 1)
+	{
+		//Best path only, no need to merge
+		T bestEnergy = ski::MaxValue<T>();
+		int bestState = pN;
+		for (int p = pN; p < pNEnd; p++)
+		{
+			T energy = (prior + conditional(p, n)) + prevEnergies[p];
+			if (energy < bestEnergy)
+			{
+				bestEnergy = energy;
+				bestState = p;
+			}
+		}
+		*e = bestEnergy;
+		*b = bestState;
+		return;
+	}
+	//Only the previous states with the nPaths_ best first paths can contribute to the best nPaths_ paths,
+	//as the paths into each previous state are in increasing order. Keep these sorted while scanning.
+	const int nPaths = nPaths_;
+	candidates_.resize(nPaths);
+	Candidate *best = &candidates_[0];
+	int nBest = 0;
+	T worstEnergy = ski::MaxValue<T>();	//energy to beat once nPaths candidates are found
+	for (int p = pN; p < pNEnd; p++)
+	{
+		T transition = prior + conditional(p, n), energy = transition + prevEnergies[p * nPaths];
+		if ( (nBest == nPaths) && !(energy < worstEnergy) )
+			continue;
+		int i = (nBest < nPaths ? nBest++ : nBest - 1);
+		for (; (i > 0) && (energy < best[i - 1].energy); i--)
+			best[i] = best[i - 1];
+		best[i] = Candidate(energy, transition, p, 0);
+		worstEnergy = best[nBest - 1].energy;
+	}
+	candidates_.resize(nBest);
+	//Merge the sorted paths of these previous states with a min-heap, which the candidates already are as they are sorted
+	for (int k = 0; k < nPaths_; k++)
+	{
+		pop_heap(candidates_.begin(), candidates_.end(), IsWorse());
+		Candidate &best = candidates_.back();
+		e[k] = best.energy;
+		b[k] = best.prevState * nPaths_ + best.prevPath;
+		if (++best.prevPath < nPaths_)
+		{
+			best.energy = best.transition + prevEnergies[best.prevState * nPaths_ + best.prevPath];
+			push_heap(candidates_.begin(), candidates_.end(), IsWorse());
+		}
+		else
+			candidates_.pop_back();
+	}
+}
+
+template <typename T>
+void FlatViterbi<T>::backtrack(int finalState)
+{
+	int offset = offsets_[time_-1];
+	finalPaths_.clear();
+	if (finalState == -1)
+	{
+		//Best paths over all final states
+		for (int i = 0; i < offsets_[time_] - offset; i++)
+			finalPaths_.push_back(std::pair<T, int>(energies_[offset + i], i));
+		partial_sort(finalPaths_.begin(), finalPaths_.begin() + nPaths_, finalPaths_.end());
+	}
+	else
+	{
+		for (int k = 0; k < nPaths_; k++)
+			finalPaths_.push_back(std::pair<T, int>(energies_[offset + finalState * nPaths_ + k], finalState * nPaths_ + k));
+	}
+	for (int k = 0; k < nPaths_; k++)
+	{
+		solutions[k].energy = finalPaths_[k].first;
+		int i = finalPaths_[k].second;
+		for (int t = time_-1; t >= 0; t--)
+		{
+			solutions[k].sequence[t] = i / nPaths_;
+			if (t > 0)
+				i = backPointers_[offsets_[t] + i];
+		}
+	}
+}
+
+//=================================
+//Implements the Viterbi algorithm for a fixed number of states
+//=================================
+/**
+ * Minimum energy Viterbi path detection for problems whose number of states and paths are known at compile time.
+ * The priors and conditionals are kept in fixed-size aligned arrays owned by the class, and each step is a min-plus
+ * product whose inner loop runs over the next states, so that the compiler can vectorize it.
+ * Using float energies fits twice as many states per vector as double.
+ */
+template <typename T, int NStates, int NPaths=1>
+class FixedViterbi
+{
+public:
+	typedef typename Viterbi<T>::Solution Solution;
+
+	/** Energies of one step, aligned so that the rows can be loaded as vectors */
+	struct Step
+	{
+		/** prior[j] is the energy of state j at this time */
+		alignas(16) T prior[NStates];
+		/** conditional[i][j] is the energy to move from state i at the previous time to state j at this time, unused at time 0 */
+		alignas(16) T conditional[NStates][NStates];
+	};
+
+	/**
+	 * Constructor
+	 * @param[in] time sequence length
+	 */
+	FixedViterbi(int time=0);
+
+	/**
+	 * Resizes the sequence, keeping the storage of longer sequences
+	 * @param[in] time sequence length
+	 */
+	void resize(int time);
+
+	/** Sequence length */
+	inline int time() const {return (int) steps_.size(); };
+
+	/**
+	 * Energies of a step, to be filled in before solving
+	 * @param[in] t time of the step
+	 * @return the energies of step t
+	 */
+	inline Step& step(int t) {return steps_[t]; };
+
+	/**
+	 * Solves the Viterbi algorithm.
+	 * @param[in] finalState index of the final state to end. By default, just finds the best state.
+	 * If given a valid index, backtracks from that specific state.
+	 */
+	void solve(int finalState=-1);
+
+	/** Holds the solutions to the Viterbi, sorted in order of increasing energy*/
+	vector<Solution> solutions;
+private:
+	/** Path energies at one time, energies[k][j] is the energy of the k'th best path into state j */
+	struct Energies
+	{
+		alignas(16) T energies[NPaths][NStates];
+	};
+
+	/** Steps of the sequence */
+	vector<Step> steps_;
+	/** Path energies at the last time */
+	Energies pathEnergies_;
+	/** backPointers_[t * NPaths * NStates + k * NStates + j] is the path at time t-1 that the k'th best path into state j comes from,
+	 * as prevPath * NStates + prevState */
+	vector<int> backPointers_;
+};
+
+template <typename T, int NStates, int NPaths>
+FixedViterbi<T, NStates, NPaths>::FixedViterbi(int time/*=0*/):
+	solutions(NPaths)
+{
+	resize(time);
+}
+
+template <typename T, int NStates, int NPaths>
+void FixedViterbi<T, NStates, NPaths>::resize(int time)
+{
+	steps_.resize(time);
+	if ((int) backPointers_.size() < time * NPaths * NStates)
+		backPointers_.resize(time * NPaths * NStates);
+	for (typename vector<Solution>::iterator s = solutions.begin(); s != solutions.end(); s++)
+		s->sequence.resize(time);
+}
+
+template <typename T, int NStates, int NPaths>
+void FixedViterbi<T, NStates, NPaths>::solve(int finalState/*=-1*/)
+{
+	if ( (finalState >= NStates) || (finalState < -1) )
+		throw invalid_argument("FixedViterbi: Final state not valid.");
+	if (steps_.empty())
+		throw logic_error("FixedViterbi: Empty sequence.");
+	//The first path into each state is its prior, the others are not possible
+	T (*e)[NStates] = pathEnergies_.energies;
+	for (int j = 0; j < NStates; j++)
+	{
+		e[0][j] = steps_[0].prior[j];
+		for (int k = 1; k < NPaths; k++)
+			e[k][j] = ski::MaxValue<T>() / 2;
+	}
+	Energies next;
+	//Back pointers are kept in T during the step, so that the selects have the same width as the energies
+	alignas(16) T from[NPaths][NStates];
+	for (int t = 1; t < time(); t++)
+	{
+		const Step &s = steps_[t];
+		T (*n)[NStates] = next.energies;
+		for (int k = 0; k < NPaths; k++)
+		{
+			for (int j = 0; j < NStates; j++)
+			{
+				n[k][j] = ski::MaxValue<T>();
+				from[k][j] = 0;
+			}
+		}
+		for (int i = 0; i < NStates; i++)
+		{
+			const T *c = s.conditional[i];
+			for (int p = 0; p < NPaths; p++)
+			{
+				const T prevEnergy = e[p][i], prevPath = (T) (p * NStates + i);
+				for (int j = 0; j < NStates; j++)
+				{
+					//Insert into the sorted paths into state j without branching
+					T energy = (s.prior[j] + c[j]) + prevEnergy, path = prevPath;
+					for (int k = 0; k < NPaths; k++)
+					{
+						//Load, select and then store, which compilers turn into vector blends
+						T kEnergy = n[k][j], kPath = from[k][j];
+						T bestEnergy = (energy < kEnergy ? energy : kEnergy), bestPath = (energy < kEnergy ? path : kPath);
+						T worseEnergy = (energy < kEnergy ? kEnergy : energy), worsePath = (energy < kEnergy ? kPath : path);
+						n[k][j] = bestEnergy;
+						from[k][j] = bestPath;
+						energy = worseEnergy;
+						path = worsePath;
+					}
+				}
+			}
+		}
+		int *b = &backPointers_[t * NPaths * NStates];
+		for (int k = 0; k < NPaths; k++)
+		{
+			for (int j = 0; j < NStates; j++)
+			{
+				e[k][j] = n[k][j];
+				b[k * NStates + j] = (int) from[k][j];
+			}
+		}
+	}
+	//Find the final paths, as k * NStates + j
+	std::pair<T, int> finalPaths[NPaths * NStates];
+	if (finalState == -1)
+	{
+		//Best paths over all final states
+		for (int path = 0; path < NPaths * NStates; path++)
+			finalPaths[path] = std::pair<T, int>(e[path / NStates][path % NStates], path);
+		partial_sort(finalPaths, finalPaths + NPaths, finalPaths + NPaths * NStates);
+	}
+	else
+	{
+		for (int k = 0; k < NPaths; k++)
+			finalPaths[k] = std::pair<T, int>(e[k][finalState], k * NStates + finalState);
+	}
+	//Backtrack
+	for (int k = 0; k < NPaths; k++)
+	{
+		int path = finalPaths[k].second;
+		solutions[k].energy = finalPaths[k].first;
+		for (int t = time() - 1; t >= 0; t--)
+		{
+			solutions[k].sequence[t] = path % NStates;
+			if (t > 0)
+				path = backPointers_[t * NPaths * NStates + path];
+		}
+	}
+}
+
+//=================================
+//Implements the Viterbi algorithm for a batch of chains
+//=================================
+/**
+ * Minimum energy Viterbi path detection for a batch of independent chains that have the same number of states at each time.
+ * The energies are laid out with the chains innermost (structure of arrays), so that each step of the recursion
+ * runs over blocks of BLOCK_SIZE chains at once in fixed length loops that the compiler can vectorize.
+ * The arrays of energies are padded to a whole number of blocks, and the padding is ignored.
+ * The forward pass only keeps the sorted path energies, with min and max rather than selects, which the compiler
+ * turns into branches. The back pointers of the solutions are recovered while backtracking, by finding the path
+ * at the previous time whose energy adds up to the same value.
+ * Transitions that are not possible in a chain are given an energy of ski::MaxValue<T>() / 2.
+ */
+template <typename T=double>
+class BatchViterbi
+{
+public:
+	typedef typename Viterbi<T>::Solution Solution;
+
+	/** Number of chains processed together */
+	static const int BLOCK_SIZE = 8;
+
+	/**
+	 * Constructor
+	 * @param[in] nPaths number of paths to return for each chain.
+	 */
+	BatchViterbi(int nPaths=1);
+
+	/**
+	 * Sizes the batch, keeping the storage of larger batches
+	 * @param[in] nChains number of chains
+	 * @param[in] nStates nStates[t] is the number of states at time t in all the chains
+	 */
+	void resize(int nChains, const vector<int> &nStates);
+
+	/** Number of chains in the batch */
+	inline int nChains() const {return nChains_; };
+
+	/** Number of paths returned for each chain */
+	inline int nPaths() const {return nPaths_; };
+
+	/** Sequence length */
+	inline int time() const {return (int) nStates_.size(); };
+
+	/**
+	 * Prior energies of a state, to be filled in before solving
+	 * @param[in] t time
+	 * @param[in] i index of the state at time t
+	 * @return array whose element b is the energy of state i at time t in chain b
+	 */
+	inline T* prior(int t, int i) {return &priors_[priorOffsets_[t] + i * stride_]; };
+
+	/**
+	 * Conditional energies of a transition, to be filled in before solving
+	 * @param[in] t time, must be positive
+	 * @param[in] i index of the state at time t-1
+	 * @param[in] j index of the state at time t
+	 * @return array whose element b is the energy to move from state i at time t-1 to state j at time t in chain b
+	 */
+	inline T* conditional(int t, int i, int j) {return &conditionals_[conditionalOffsets_[t] + (i * nStates_[t] + j) * stride_]; };
+
+	/**
+	 * Solves the Viterbi algorithm for all the chains.
+	 * @param[in] finalState index of the final state to end. By default, just finds the best state of each chain.
+	 * If given a valid index, backtracks from that specific state.
+	 */
+	void solve(int finalState=-1);
+
+	/** Holds the solutions, solutions[b * nPaths + k] is the k'th best solution of chain b, in order of increasing energy */
+	vector<Solution> solutions;
+private:
+	/**
+	 * Backtracks the solutions of a chain
+	 * @param[in] b index of the chain
+	 * @param[in] finalState final state to backtrack from, -1 for the best final states
+	 */
+	void backtrack(int b, int finalState);
+
+	/** number of paths to track */
+	int nPaths_;
+	/** number of chains */
+	int nChains_;
+	/** number of chains rounded up to a whole number of blocks, the distance between the energies of consecutive states */
+	int stride_;
+	/** number of states at each time */
+	vector<int> nStates_;
+	/** Priors of state i at time t start at priors_[priorOffsets_[t] + i * stride_] */
+	vector<int> priorOffsets_;
+	/** Conditionals from state i at time t-1 to state j at time t start at conditionals_[conditionalOffsets_[t] + (i * nStates_[t] + j) * stride_] */
+	vector<int> conditionalOffsets_;
+	/** Prior energies */
+	vector<T> priors_;
+	/** Conditional energies */
+	vector<T> conditionals_;
+	/** Energies of the paths at time t, the k'th best path into state j of chain b is at nPaths_ * priorOffsets_[t] + (k * nStates_[t] + j) * stride_ + b */
+	vector<T> energies_;
+	/** Scratch space for the final paths of a chain to backtrack from, as (energy, k * nStates + state) */
+	vector<std::pair<T, int> > finalPaths_;
+};
+
+template <typename T>
+BatchViterbi<T>::BatchViterbi(int nPaths/*=1*/):
+	nPaths_(nPaths),
+	nChains_(0),
+	stride_(0)
+{
+	if (nPaths_ < 1)
+		throw invalid_argument("BatchViterbi: There must be at least one path.");
+}
+
+template <typename T>
+void BatchViterbi<T>::resize(int nChains, const vector<int> &nStates)
+{
+	if ( (nChains < 0) || nStates.empty() )
+		throw invalid_argument("BatchViterbi: Invalid batch size.");
+	nChains_ = nChains;
+	stride_ = (nChains_ + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE;
+	nStates_ = nStates;
+	const int time = nStates_.size();
+	priorOffsets_.resize(time + 1);
+	conditionalOffsets_.resize(time + 1);
+	priorOffsets_[0] = conditionalOffsets_[0] = conditionalOffsets_[1] = 0;
+	for (int t = 0; t < time; t++)
+	{
+		if (nStates_[t] < 1)
+			throw invalid_argument("BatchViterbi: There must be at least one state at each time.");
+		priorOffsets_[t + 1] = priorOffsets_[t] + nStates_[t] * stride_;
+		if (t > 0)
+			conditionalOffsets_[t + 1] = conditionalOffsets_[t] + nStates_[t-1] * nStates_[t] * stride_;
+	}
+	//Only ever grow the storage
+	if ((int) priors_.size() < priorOffsets_[time])
+	{
+		priors_.resize(priorOffsets_[time]);
+		energies_.resize(priorOffsets_[time] * nPaths_);
+	}
+	if ((int) conditionals_.size() < conditionalOffsets_[time])
+		conditionals_.resize(conditionalOffsets_[time]);
+	solutions.resize(nChains_ * nPaths_);
+	for (typename vector<Solution>::iterator s = solutions.begin(); s != solutions.end(); s++)
+		s->sequence.resize(time);
+}
+
+template <typename T>
+void BatchViterbi<T>::solve(int finalState/*=-1*/)
+{
+	const int time = nStates_.size(), B = stride_;
+	if (time == 0)
+		throw logic_error("BatchViterbi: Empty sequence.");
+	if ( (finalState >= nStates_.back()) || (finalState < -1) )
+		throw invalid_argument("BatchViterbi: Final state not valid.");
+	//The first path into each state is its prior, the others are not possible
+	std::copy(priors_.begin(), priors_.begin() + priorOffsets_[1], energies_.begin());
+	std::fill(energies_.begin() + priorOffsets_[1], energies_.begin() + priorOffsets_[1] * nPaths_, ski::MaxValue<T>() / 2);
+	for (int t = 1; t < time; t++)
+	{
+		const int nPrevStates = nStates_[t-1], nStates = nStates_[t];
+		const T *e = &energies_[nPaths_ * priorOffsets_[t-1]];
+		T *n = &energies_[nPaths_ * priorOffsets_[t]];
+		std::fill(n, n + nPaths_ * nStates * B, ski::MaxValue<T>());
+		for (int j = 0; j < nStates; j++)
+		{
+			const T *pr = prior(t, j);
+			for (int i = 0; i < nPrevStates; i++)
+			{
+				const T *c = conditional(t, i, j);
+				for (int p = 0; p < nPaths_; p++)
+				{
+					const T *prevEnergies = e + (p * nPrevStates + i) * B;
+					for (int b0 = 0; b0 < B; b0 += BLOCK_SIZE)
+					{
+						T energy[BLOCK_SIZE];
+						for (int b = 0; b < BLOCK_SIZE; b++)
+							energy[b] = (pr[b0 + b] + c[b0 + b]) + prevEnergies[b0 + b];
+						//Insert into the sorted paths into state j of each chain
+						for (int k = 0; k < nPaths_; k++)
+						{
+							T *nK = n + (k * nStates + j) * B + b0;
+							for (int b = 0; b < BLOCK_SIZE; b++)
+							{
+								const T pathEnergy = nK[b];
+								nK[b] = min(pathEnergy, energy[b]);
+								energy[b] = max(pathEnergy, energy[b]);
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+	for (int b = 0; b < nChains_; b++)
+		backtrack(b, finalState);
+}
+
+template <typename T>
+void BatchViterbi<T>::backtrack(int b, int finalState)
+{
+	const int time = nStates_.size(), B = stride_;
+	const int nFinalStates = nStates_.back();
+	const T *e = &energies_[nPaths_ * priorOffsets_[time-1]];
+	finalPaths_.clear();
+	if (finalState == -1)
+	{
+		//Best paths over all final states
+		for (int path = 0; path < nPaths_ * nFinalStates; path++)
+			finalPaths_.push_back(std::pair<T, int>(e[path * B + b], path));
+		partial_sort(finalPaths_.begin(), finalPaths_.begin() + nPaths_, finalPaths_.end());
+	}
+	else
+	{
+		for (int k = 0; k < nPaths_; k++)
+			finalPaths_.push_back(std::pair<T, int>(e[(k * nFinalStates + finalState) * B + b], k * nFinalStates + finalState));
+	}
+	for (int k = 0; k < nPaths_; k++)
+	{
+		Solution &s = solutions[b * nPaths_ + k];
+		s.energy = finalPaths_[k].first;
+		int path = finalPaths_[k].second;
+		for (int t = time - 1; t > 0; t--)
+		{
+			const int nPrevStates = nStates_[t-1], nStates = nStates_[t], state = path % nStates;
+			const T *n = &energies_[nPaths_ * priorOffsets_[t]], *prevEnergies = &energies_[nPaths_ * priorOffsets_[t-1]];
+			s.sequence[t] = state;
+			//Paths with equal energies are kept in the order they were inserted, so the path is the rank'th one with its energy
+			const T energy = n[path * B + b];
+			int rank = 0;
+			for (int k = path / nStates - 1; k >= 0; k--)
+				rank += (n[(k * nStates + state) * B + b] == energy ? 1 : 0);
+			const T pr = prior(t, state)[b];
+			int prevPath = -1;
+			for (int i = 0; (i < nPrevStates) && (prevPath < 0); i++)
+			{
+				const T transition = pr + conditional(t, i, state)[b];
+				for (int p = 0; p < nPaths_; p++)
+				{
+					if ( (transition + prevEnergies[(p * nPrevStates + i) * B + b] == energy) && (rank-- == 0) )
+					{
+						prevPath = p * nPrevStates + i;
+						break;
+					}
+				}
+			}
+			if (prevPath < 0)
+				throw logic_error("BatchViterbi: Path energies are not consistent.");
+			path = prevPath;
+		}
+		s.sequence[0] = path % nStates_[0];
+	}
+}
+
 #ifdef _LIBTEST
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 
 void testViterbi()
 {
@@ -536,6 +1309,215 @@ void testViterbi()
 	//V.bestSequence(4,1);
 	//P=[0 2 1 1; 0 1 2 1; 1 2 1 1; 0 2 2 1] (sequences are rows)
 }
+
+/**
+ * Compares FlatViterbi with Viterbi on random energies, with and without bands, and prints their timings
+ */
+void testFlatViterbi()
+{
+	typedef Viterbi<double>::TMatrix_ TMatrix_;
+	const int T = 20, nStates = 50, nTrials = 200;
+	vector<vector<double> > prior(T, vector<double>(nStates));
+	vector<TMatrix_> cond;
+	for (int t = 0; t < T - 1; t++)
+		cond.push_back(TMatrix_(nStates, nStates));
+	vector<Viterbi<double>::TBand_> bands(T - 1, Viterbi<double>::TBand_(nStates));
+	srand(1);
+	for (int isBanded = 0; isBanded < 2; isBanded++)
+	{
+		for (int nPaths = 1; nPaths <= 8; nPaths *= 2)
+		{
+			Viterbi<double> V(prior, cond, nPaths, (isBanded ? &bands : NULL));
+			FlatViterbi<double> FV(prior, cond, nPaths, (isBanded ? &bands : NULL));
+			double time = 0, flatTime = 0;
+			int nMismatches = 0;
+			for (int trial = 0; trial < nTrials; trial++)
+			{
+				for (int t = 0; t < T; t++)
+				{
+					for (int n = 0; n < nStates; n++)
+						prior[t][n] = rand() % 1000;	//integral, so that both sum exactly and ties are possible
+				}
+				for (int t = 0; t < T - 1; t++)
+				{
+					for (int i = 0; i < nStates; i++)
+					{
+						for (int j = 0; j < nStates; j++)
+							cond[t](i, j) = rand() % 1000;
+					}
+					for (int n = 0; n < nStates; n++)
+					{
+						int first = max(0, n - 1 - rand() % 4);
+						bands[t][n] = Viterbi<double>::TRange_(first, (n % 7 == 3 ? first : min(nStates, n + 1 + rand() % 4)));
+					}
+				}
+				int finalState = (trial % 2 == 0 ? -1 : rand() % nStates);
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				V.solve(finalState);
+				std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+				FV.solve(finalState);
+				std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+				time += std::chrono::duration<double>(middle - start).count();
+				flatTime += std::chrono::duration<double>(end - middle).count();
+				//Paths may differ on ties, but their energies may not
+				for (int p = 0; p < nPaths; p++)
+					nMismatches += (V.solutions[p].energy == FV.solutions[p].energy ? 0 : 1);
+			}
+			printf("%s, %d paths: %d energy mismatches, Viterbi %.1f us, FlatViterbi %.1f us\n", (isBanded ? "banded" : "dense"),
+					nPaths, nMismatches, 1e6 * time / nTrials, 1e6 * flatTime / nTrials);
+		}
+	}
+}
+
+/**
+ * Runs FixedViterbi on the energies of a Viterbi problem and returns the time it took
+ */
+template <typename T, int NStates, int NPaths>
+double timeFixedViterbi(FixedViterbi<T, NStates, NPaths> &FV, const vector<vector<double> > &prior, const vector<Viterbi<double>::TMatrix_> &cond, int finalState)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int t = 0; t < FV.time(); t++)
+	{
+		typename FixedViterbi<T, NStates, NPaths>::Step &s = FV.step(t);
+		for (int j = 0; j < NStates; j++)
+		{
+			s.prior[j] = (T) prior[t][j];
+			for (int i = 0; (t > 0) && (i < NStates); i++)
+				s.conditional[i][j] = (T) cond[t-1](i, j);
+		}
+	}
+	FV.solve(finalState);
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Compares FixedViterbi with double and float energies to Viterbi on random energies of a UPC-A sized problem, and prints their timings
+ */
+template <int NPaths>
+void testFixedViterbi()
+{
+	typedef Viterbi<double>::TMatrix_ TMatrix_;
+	const int T = 12, nStates = 10, nTrials = 20000;
+	vector<vector<double> > prior(T, vector<double>(nStates));
+	vector<TMatrix_> cond;
+	for (int t = 0; t < T - 1; t++)
+		cond.push_back(TMatrix_(nStates, nStates));
+	Viterbi<double> V(prior, cond, NPaths);
+	FixedViterbi<double, 10, NPaths> FV(T);
+	FixedViterbi<float, 10, NPaths> FVf(T);
+	double time = 0, fixedTime = 0, floatTime = 0, maxFloatError = 0;
+	int nMismatches = 0;
+	srand(1);
+	for (int trial = 0; trial < nTrials; trial++)
+	{
+		for (int t = 0; t < T; t++)
+		{
+			for (int n = 0; n < nStates; n++)
+				prior[t][n] = 5.0 * rand() / RAND_MAX;
+		}
+		for (int t = 0; t < T - 1; t++)
+		{
+			for (int i = 0; i < nStates; i++)
+			{
+				for (int j = 0; j < nStates; j++)
+					cond[t](i, j) = 5.0 * rand() / RAND_MAX;
+			}
+		}
+		int finalState = (trial % 2 == 0 ? -1 : 0);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		V.solve(finalState);
+		time += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		fixedTime += timeFixedViterbi(FV, prior, cond, finalState);
+		floatTime += timeFixedViterbi(FVf, prior, cond, finalState);
+		for (int p = 0; p < NPaths; p++)
+		{
+			nMismatches += ( (V.solutions[p].energy == FV.solutions[p].energy) && (V.solutions[p].sequence == FV.solutions[p].sequence) ? 0 : 1);
+			maxFloatError = max(maxFloatError, fabs(V.solutions[p].energy - FVf.solutions[p].energy));
+		}
+	}
+	printf("%d paths: %d mismatches with double, float energy error up to %g; Viterbi %.2f us, FixedViterbi double %.2f us, float %.2f us\n",
+			NPaths, nMismatches, maxFloatError, 1e6 * time / nTrials, 1e6 * fixedTime / nTrials, 1e6 * floatTime / nTrials);
+}
+
+/**
+ * Compares BatchViterbi to Viterbi on batches of random energies of a UPC-A sized problem, and prints their timings per chain
+ * @param[in] nChains number of chains in each batch
+ * @param[in] nPaths number of paths to find
+ */
+template <typename T>
+void testBatchViterbi(int nChains, int nPaths)
+{
+	typedef typename Viterbi<double>::TMatrix_ TMatrix_;
+	const int time = 12, nStates = 10, nTrials = 40000 / nChains;
+	vector<vector<vector<double> > > priors(nChains, vector<vector<double> >(time, vector<double>(nStates)));
+	vector<vector<TMatrix_> > conditionals(nChains);
+	vector<Viterbi<double>*> V;
+	for (int b = 0; b < nChains; b++)
+	{
+		for (int t = 0; t < time - 1; t++)
+			conditionals[b].push_back(TMatrix_(nStates, nStates));
+		V.push_back(new Viterbi<double>(priors[b], conditionals[b], nPaths));
+	}
+	BatchViterbi<T> BV(nPaths);
+	BV.resize(nChains, vector<int>(time, nStates));
+	double viterbiTime = 0, batchTime = 0, maxError = 0;
+	int nMismatches = 0;
+	srand(1);
+	for (int trial = 0; trial < nTrials; trial++)
+	{
+		for (int b = 0; b < nChains; b++)
+		{
+			for (int t = 0; t < time; t++)
+			{
+				for (int i = 0; i < nStates; i++)
+				{
+					priors[b][t][i] = 5.0 * rand() / RAND_MAX;
+					for (int j = 0; (t > 0) && (j < nStates); j++)
+						conditionals[b][t-1](i, j) = 5.0 * rand() / RAND_MAX;
+				}
+			}
+		}
+		int finalState = (trial % 2 == 0 ? -1 : 0);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int b = 0; b < nChains; b++)
+			V[b]->solve(finalState);
+		std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+		for (int t = 0; t < time; t++)
+		{
+			for (int i = 0; i < nStates; i++)
+			{
+				T *p = BV.prior(t, i);
+				for (int b = 0; b < nChains; b++)
+					p[b] = (T) priors[b][t][i];
+				for (int j = 0; (t > 0) && (j < nStates); j++)
+				{
+					T *c = BV.conditional(t, j, i);
+					for (int b = 0; b < nChains; b++)
+						c[b] = (T) conditionals[b][t-1](j, i);
+				}
+			}
+		}
+		std::chrono::steady_clock::time_point filled = std::chrono::steady_clock::now();
+		BV.solve(finalState);
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		viterbiTime += std::chrono::duration<double>(middle - start).count();
+		batchTime += std::chrono::duration<double>(end - filled).count();
+		for (int b = 0; b < nChains; b++)
+		{
+			for (int k = 0; k < nPaths; k++)
+			{
+				const typename BatchViterbi<T>::Solution &s = BV.solutions[b * nPaths + k];
+				maxError = max(maxError, fabs(V[b]->solutions[k].energy - s.energy));
+				nMismatches += ( (sizeof(T) < sizeof(double)) || ( (V[b]->solutions[k].energy == s.energy) && (V[b]->solutions[k].sequence == s.sequence) ) ? 0 : 1);
+			}
+		}
+	}
+	for (int b = 0; b < nChains; b++)
+		delete V[b];
+	printf("%d chains of %d paths in %s: %d mismatches, energy error up to %g; Viterbi %.2f us, BatchViterbi %.2f us per chain\n",
+			nChains, nPaths, (sizeof(T) < sizeof(double) ? "float" : "double"), nMismatches, maxError,
+			1e6 * viterbiTime / (nTrials * nChains), 1e6 * batchTime / (nTrials * nChains));
+}
 #endif //LIBTEST
 
 #endif // VITERBI_H